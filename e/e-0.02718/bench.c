@@ -0,0 +1,239 @@
+/* vi:set ts=2: */
+
+/* nanoseconds per evaluation of a few expressions over $1: evaluated while */
+/* parsing as e used to, by the bytecode interpreter, as native code, and */
+/* in batches; csv on standard output, invoked by make bench */
+
+#define main e
+#include "e.c"
+#undef main
+
+#include <time.h>
+
+#define N 2000000
+
+char *exprs[] =
+	{
+		"$1+1",
+		"$1*$1-2*$1+1",
+		"($1+1)*($1-1)/($1*$1+1)-$1/3+$1/7",
+		"sqrt[$1]*ln[$1+1]+sin[$1]^2",
+		"exp[-$1]*cos[$1]+abs[$1-1]",
+		"pi/180*sqrt[$1*$1+4]/sqrt[$1*$1+4+1]",
+		0
+	};
+
+/* the direct evaluator, parsing the string again for every value */
+
+char dc, *dp;
+type dx;
+
+void dnext()
+{
+	do dc = *dp ? *dp++ : 0; while(dc == ' ');
+}
+
+type dE();
+type dterm();
+
+type dconstant()
+{
+	type r = 0;
+
+	while(dc >= '0' && dc <= '9')
+		{ r = 10*r + (dc-'0'); dnext(); }
+
+	if(dc == '.')
+		{
+			type p = 0.1;
+			dnext();
+
+			while(dc >= '0' && dc <= '9')
+				{ r += p * (dc-'0'); p /= 10; dnext(); }
+		}
+
+	if(dc == 'e' || dc == 'E')
+		{
+			type m = 1;
+
+			dnext();
+			if(dc == '-') { m = -m; dnext(); } else if(dc == '+') dnext();
+
+			r *= pow(10,m*dterm());
+		}
+
+	return r;
+}
+
+type dfunction()
+{
+	char f[20], *q = f;
+	int i;
+	type v;
+
+	while(q-f < 19 && dc >= 'a' && dc <= 'z') { *q++ = dc; dnext(); }
+	*q = 0;
+
+	if(!strcmp(f,"pi")) return M_PI;
+	if(!strcmp(f,"e" )) return M_E;
+
+	v = dterm();
+
+	for(i=0;funcs[i].name;i++)
+		if(!strcmp(f,funcs[i].name)) return funcs[i].f(v);
+
+	return 0;
+}
+
+type dterm()
+{
+	if(dc=='(' || dc=='[')
+		{
+			type r;
+
+			dnext();
+			r = dE();
+			dnext();
+			return r;
+		}
+
+	else if((dc >= '0' && dc <= '9') || dc == '.')
+					return dconstant();
+
+	else if(dc >= 'a' && dc <= 'z')
+					return dfunction();
+
+	else if(dc == '$')
+		{
+			do dnext(); while(dc >= '0' && dc <= '9');
+			return dx;
+		}
+
+	return 0;
+}
+
+type dH()
+{
+	type r = dterm();
+
+	if(dc == '!') { dnext(); r = factorial(r); }
+	return r;
+}
+
+type dG()
+{
+	type q, r = dH();
+
+	while(dc == '^')
+		{ dnext(); q = dG(); r = pow(r,q); }
+
+	return r;
+}
+
+type dF()
+{
+	type r = dG();
+
+	while(1)
+		{
+			if(dc=='*') { dnext(); r *= dG(); }
+			else
+			if(dc=='/') { dnext(); r /= dG(); }
+			else
+			if(dc=='%') { dnext(); r = fmod(r,dG()); }
+			else break;
+		}
+
+	return r;
+}
+
+type dE()
+{
+	type r = dF();
+
+	while(1)
+		{
+			if(dc=='+') { dnext(); r += dF(); }
+			else
+			if(dc=='-') { dnext(); r -= dF(); }
+			else break;
+		}
+
+	return r;
+}
+
+/* e's compiler, from a clean slate every time */
+
+void compile(char *s)
+{
+	static char *av[3];
+
+	av[0] = "e"; av[1] = s;
+	argc = 2; argv = av; arg = 1; p = s;
+
+	ncode = nreg = nvar = ncol = carry = 0;
+	memset(col,0,sizeof(col));
+	memset(set,0,sizeof(set));
+	memset(konst,0,sizeof(konst));
+	memset(seen,0,sizeof(seen));
+	native = 0;
+
+	number(0);
+	next();
+	result = S();
+	prune();
+}
+
+double now()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec*1e9 + t.tv_nsec;
+}
+
+#define X(k) (1 + (k)*1e-6)
+
+int main()
+{
+	double t, direct, interp_, native_, batch;
+	volatile type sink = 0;
+	int e, k, j;
+
+	printf("expression,direct,bytecode,native,batch\n");
+
+	for(e=0;exprs[e];e++)
+		{
+			t = now();
+			for(k=0;k<N;k++) { dx = X(k); dp = exprs[e]; dnext(); sink += dE(); }
+			direct = (now()-t)/N;
+
+			compile(exprs[e]);
+			t = now();
+			for(k=0;k<N;k++) { reg[col[1]] = X(k); sink += interp(); }
+			interp_ = (now()-t)/N;
+
+			jit();
+			t = now();
+			for(k=0;k<N;k++) { reg[col[1]] = X(k); sink += run(); }
+			native_ = native ? (now()-t)/N : 0;
+
+			vec = aligned_alloc(64,nreg*BATCH*sizeof(type));
+			for(k=0;k<nreg;k++)
+				for(j=0;j<BATCH;j++) V(k)[j] = reg[k];
+
+			t = now();
+			for(k=0;k<N;k+=BATCH)
+				{
+					for(j=0;j<BATCH;j++) V(col[1])[j] = X(k+j);
+					runv();
+					for(j=0;j<BATCH;j++) sink += V(result)[j];
+				}
+			batch = (now()-t)/N;
+			free(vec);
+
+			printf("\"%s\",%.2f,%.2f,%.2f,%.2f\n", exprs[e], direct, interp_, native_, batch);
+		}
+
+	return 0;
+}
@@ -3,7 +3,16 @@
 /* tab size is 2 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <errno.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define NATIVE
+#endif
 
 typedef double type;  
 
@@ -61,112 +70,513 @@ void unknown(char *s)
 }
 
 
-type E();
-type term();
+/* the parser compiles the expression into body[], run() evaluates it */
+/* every instruction writes a register of its own, constants are preloaded */
+
+/* register 0 always holds 0, variables and columns get a register each */
+
+#define MAXCODE 4096
+#define MAXVAR  64
+#define MAXCOL  1024
+
+enum { ADD, SUB, MUL, DIV, MOD, POW, FACT, FUNC, SET };
+
+typedef struct { unsigned short op, d, a, b; } code;
+
+code body[MAXCODE];
+type reg[MAXCODE];
+int ncode, nreg, result;
+
+struct { char name[20]; int r; } vars[MAXVAR];
+int nvar;
+
+int col[MAXCOL+1], ncol;
+
+char set[MAXCODE];
+int carry;
+
+static inline unsigned long long bits(type x) { unsigned long long u; memcpy(&u,&x,8); return u; }
+static inline type real(unsigned long long u) { type x; memcpy(&x,&u,8); return x; }
+
+void toolong()
+{
+	printf("expression too long\n");
+	exit(1);
+}
+
+/* a register of its own, for variables and columns */
+
+int fresh(type v)
+{
+	if(nreg == MAXCODE) toolong();
+	
+	reg[nreg] = v;
+	return nreg++;
+}
+
+/* hash-consing: each constant is stored once and each value computed once, */
+/* assigning a variable forgets the values computed so far */
+
+#define HASH  8192
+#define CONST SET+1
+
+struct { int op, a, b, r, gen; type v; } seen[HASH];
+int gen = 1;
+
+char konst[MAXCODE];
+
+type fold(int op, type x, type y, int f);
+
+int lookup(int op, int a, int b, type v)
+{
+	unsigned long long h = op == CONST ? bits(v) : (op*8191ULL + a)*65521ULL + b;
+	int i;
+	
+	h ^= h >> 29; h *= 0xbf58476d1ce4e5b9ULL; h ^= h >> 32;
+	
+	for(i=h&(HASH-1);seen[i].r;i=(i+1)&(HASH-1))
+		if(seen[i].op == op && (op == CONST ? bits(seen[i].v) == bits(v) :
+			 seen[i].a == a && seen[i].b == b && seen[i].gen == gen)) break;
+	
+	seen[i].op = op; seen[i].a = a; seen[i].b = b; seen[i].v = v;
+	return i;
+}
+
+int number(type v)
+{
+	int i = lookup(CONST,0,0,v);
+	
+	if(!seen[i].r) { seen[i].r = fresh(v)+1; konst[nreg-1] = 1; }
+	return seen[i].r-1;
+}
+
+/* x^1, x*1, x/1, x-0 and x+-0 are x, x*2 is x+x, x^2 is x*x and x/2^k is */
+/* x*2^-k, all exact; anything else on constants is folded */
+
+int emit(int op, int a, int b)
+{
+	code *i;
+	int h = 0, t, e;
+	type v;
+	
+	if(op == SET) gen++;
+	else
+		{
+			if(konst[a] && (op >= FACT || konst[b])) return number(fold(op,reg[a],reg[b],b));
+			
+			if(op == MUL && konst[a]) { t = a; a = b; b = t; }
+			
+			if(op < FACT && konst[b])
+				{
+					v = reg[b];
+					
+					if(v == 1 && (op == MUL || op == DIV || op == POW)) return a;
+					if(v == 0 && op == SUB && !signbit(v)) return a;
+					if(v == 0 && op == ADD && signbit(v)) return a;
+					
+					if(v == 2 && op == MUL) { op = ADD; b = a; }
+					else
+					if(v == 2 && op == POW) { op = MUL; b = a; }
+					else
+					if(op == DIV && fabs(frexp(v,&e)) == 0.5 && e > -1022 && e < 1024) { op = MUL; b = number(1/v); }
+				}
+			
+			if((op == ADD || op == MUL) && a > b) { t = a; a = b; b = t; }
+			
+			h = lookup(op,a,b,0);
+			if(seen[h].r) return seen[h].r-1;
+		}
+	
+	if(nreg == MAXCODE || ncode == MAXCODE) toolong();
+	
+	i = body + ncode++;
+	i->op = op; i->d = nreg; i->a = a; i->b = b;
+	
+	if(op != SET) { seen[h].r = nreg+1; seen[h].gen = gen; }
+	return nreg++;
+}
+
+int variable(char *f, int make)
+{
+	int i;
+	
+	for(i=0;i<nvar;i++)
+		if(!strcmp(f,vars[i].name)) return vars[i].r;
+	
+	if(!make) return 0;
+	if(nvar == MAXVAR) toolong();
+	
+	strcpy(vars[nvar].name,f);
+	return vars[nvar++].r = fresh(0);
+}
+
+type lg(type v) { return log(v)/log(2); }
+
+/* the batch kernel for each function, ONE calls f for every value */
+
+enum { ONE, VABS, VFLOOR, VCEIL, VSQRT, VEXP, VSIN, VCOS, VLN, VLOG };
+
+struct { char *name; type (*f)(type); int v; } funcs[] =
+	{
+		{ "abs"   , fabs , VABS   },
+		{ "fabs"  , fabs , VABS   },
+		{ "floor" , floor, VFLOOR },
+		{ "ceil"  , ceil , VCEIL  },
+		{ "sqrt"  , sqrt , VSQRT  },
+		{ "exp"   , exp  , VEXP   },
+
+		{ "sin"   , sin  , VSIN   },
+		{ "cos"   , cos  , VCOS   },
+		{ "tan"   , tan  , ONE    },
+		{ "asin"  , asin , ONE    },
+		{ "acos"  , acos , ONE    },
+		{ "atan"  , atan , ONE    },
+
+		{ "sinh"  , sinh , ONE    },
+		{ "cosh"  , cosh , ONE    },
+		{ "tanh"  , tanh , ONE    },
+		{ "asinh" , asinh, ONE    },
+		{ "acosh" , acosh, ONE    },
+		{ "atanh" , atanh, ONE    },
+
+		{ "ln"    , log  , VLN    },
+		{ "log"   , lg   , VLOG   },
+		{ 0 }
+	};
+
+
+/* decimal numbers, correctly rounded: w 10^x with w the first 19 digits */
+/* is exact in one division or product when w < 2^53 and |x| <= 22, else */
+/* Eisel-Lemire gives the double from a 128 bit approximation of 10^x, */
+/* else strtod() decides the rare ambiguous or out of range cases */
+
+static const type tens[] =
+	{
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+/* 10^q for -348 <= q <= 347, its top 128 bits truncated, and for the */
+/* output side 5^i in 125 bits and 2^j / 5^i + 1 as Ryu uses them, all */
+/* built on first use from 5^q and 2^1023 / 5^-q in 32 bit limbs */
+
+#define QMIN -348
+#define QMAX 347
+#define POW5 326
+#define INV5 292
+
+unsigned long long tenhi[QMAX-QMIN+1], tenlo[QMAX-QMIN+1];
+unsigned long long pow5[POW5][2], inv5[INV5][2];
+int ready;
+
+static inline int pow5bits(int e) { return ((e * 1217359) >> 19) + 1; }
+
+/* 128 bits of x from bit s up, low word first, s may be negative */
+
+void take(unsigned int *x, int s, unsigned long long *v)
+{
+	int i, k;
+	
+	v[0] = v[1] = 0;
+	for(i=0;i<128;i++)
+		if((k = s+i) >= 0 && k < 32*32 && x[k/32] >> k%32 & 1) v[i/64] |= 1ULL << i%64;
+}
+
+int length(unsigned int *x)
+{
+	int n = 32*32;
+	
+	while(n && !(x[(n-1)/32] >> (n-1)%32 & 1)) n--;
+	return n;
+}
+
+void tables()
+{
+	unsigned int x[32];
+	unsigned long long t, v[2];
+	int q, i;
+	
+	memset(x,0,sizeof(x)); x[0] = 1;
+	for(q=0;q<=QMAX;q++)
+		{
+			take(x,length(x)-128,v); tenhi[q-QMIN] = v[1]; tenlo[q-QMIN] = v[0];
+			if(q < POW5) take(x,length(x)-125,pow5[q]);
+			for(t=0,i=0;i<32;i++) { t += 5ULL*x[i]; x[i] = t; t >>= 32; }
+		}
+	
+	memset(x,0,sizeof(x)); x[31] = 0x80000000;
+	for(q=0;q>=QMIN;q--)
+		{
+			if(q < 0) { take(x,length(x)-128,v); tenhi[q-QMIN] = v[1]; tenlo[q-QMIN] = v[0]; }
+			if(-q < INV5)
+				{
+					take(x,1023-(pow5bits(-q)-1+125),inv5[-q]);
+					if(!++inv5[-q][0]) inv5[-q][1]++;
+				}
+			for(t=0,i=31;i>=0;i--) { t = t << 32 | x[i]; x[i] = t/5; t %= 5; }
+		}
+	
+	ready = 1;
+}
+
+/* the 128 bit product of a and b */
+
+static inline unsigned long long mul(unsigned long long a, unsigned long long b, unsigned long long *lo)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 p = (unsigned __int128)a * b;
+	
+	*lo = p;
+	return p >> 64;
+#else
+	unsigned long long al = a & 0xffffffff, ah = a >> 32, bl = b & 0xffffffff, bh = b >> 32;
+	unsigned long long ll = al*bl, lh = al*bh, hl = ah*bl, hh = ah*bh;
+	unsigned long long m = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+	
+	*lo = (m << 32) | (ll & 0xffffffff);
+	return hh + (lh >> 32) + (hl >> 32) + (m >> 32);
+#endif
+}
+
+/* w 10^q in r, 0 when it can't tell */
+
+int lemire(unsigned long long w, int q, int neg, type *r)
+{
+	unsigned long long hi, lo, yhi, ylo, u, e2, m;
+	int z = 0;
+	
+	if(w == 0) { *r = neg ? -0.0 : 0.0; return 1; }
+	if(q < QMIN || q > QMAX) return 0;
+	
+	if(!ready) tables();
+	
+	while(!(w >> 63)) { w <<= 1; z++; }
+	e2 = ((217706*q) >> 16) + 64 + 1023 - z;
+	
+	hi = mul(w,tenhi[q-QMIN],&lo);
+	
+	if((hi & 0x1ff) == 0x1ff && lo + w < w)
+		{
+			yhi = mul(w,tenlo[q-QMIN],&ylo);
+			u = lo + yhi; if(u < lo) hi++; lo = u;
+			if((hi & 0x1ff) == 0x1ff && lo + 1 == 0 && ylo + w < w) return 0;
+		}
+	
+	m = hi >> 63;
+	u = hi >> (m + 9);
+	e2 -= 1 ^ m;
+	
+	if(lo == 0 && (hi & 0x1ff) == 0 && (u & 3) == 1) return 0;
+	
+	u += u & 1; u >>= 1;
+	if(u >> 53) { u >>= 1; e2++; }
+	
+	if(e2 - 1 >= 0x7fe) return 0;
+	
+	*r = real(e2 << 52 | (u & 0xfffffffffffffULL) | (unsigned long long)neg << 63);
+	return 1;
+}
+
+/* 8 digits at once when they are, in the byte order of x86 */
+
+static inline int eight(char *q, unsigned long long *v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	unsigned long long u;
+	
+	memcpy(&u,q,8);
+	if(((u & 0xf0f0f0f0f0f0f0f0ULL) | (((u + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) != 0x3333333333333333ULL) return 0;
+	
+	u -= 0x3030303030303030ULL;
+	u = u*10 + (u >> 8);
+	*v = ((u & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32)) + ((u >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32))) >> 32;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/* w 10^x from more than 19 digits: the first 19 and whether any other isn't 0 */
+
+void long19(char *q, char *end, unsigned long long *w, int *x, int *many)
+{
+	int n = 0, frac = 0;
+	
+	for(*w=0,*x=0,*many=0;q<end;q++)
+		if(*q == '.') frac = 1;
+		else
+		if(*q < '0' || *q > '9') break;
+		else
+		if(n < 19) { *w = 10 * *w + (*q-'0'); n += *w != 0; *x -= frac; }
+		else { *x += !frac; *many |= *q != '0'; }
+}
+
+/* the number in s..end, strtod for anything that isn't plain decimal */
 
-type constant()
+type scan(char *s, char *end)
 {
-	type r = 0;
+	unsigned long long w = 0, v;
+	int n, x = 0, y = 0, neg = 0, ney = 0, many = 0;
+	char *q = s, *d, *f;
+	type r, r1;
+	
+	if(q == end) return 0;
+	
+	if(*q == '-' || *q == '+') neg = *q++ == '-';
+	
+	for(d=q;end-q >= 8 && eight(q,&v);q+=8) w = 100000000*w + v;
+	for(;q<end && *q >= '0' && *q <= '9';q++) w = 10*w + (*q-'0');
+	n = q-d;
+	
+	if(q<end && *q == '.')
+		{
+			for(f=++q;end-q >= 8 && eight(q,&v);q+=8) w = 100000000*w + v;
+			for(;q<end && *q >= '0' && *q <= '9';q++) w = 10*w + (*q-'0');
+			n += q-f; x = f-q;
+		}
+	
+	if(!n) return strtod(s,NULL);
+	
+	if(q<end && (*q == 'e' || *q == 'E'))
+		{
+			q++;
+			if(q<end && (*q == '-' || *q == '+')) ney = *q++ == '-';
+			for(;q<end && *q >= '0' && *q <= '9';q++) if(y < 100000) y = 10*y + (*q-'0');
+		}
+	
+	if(q != end) return strtod(s,NULL);
+	
+	if(n > 19)
+		{
+			for(f=d;*f == '0' || *f == '.';f++) n -= *f != '.';
+			if(n > 19) long19(d,end,&w,&x,&many);
+		}
+	
+	x += ney ? -y : y;
+	
+	if(!many && !(w >> 53) && x >= -22 && x <= 22)
+		return (neg ? -1 : 1) * (x < 0 ? w / tens[-x] : w * tens[x]);
+	
+	/* with digits left out the number lies between w and w+1 */
+	
+	if(lemire(w,x,neg,&r) && (!many || (lemire(w+1,x,neg,&r1) && r == r1))) return r;
+	
+	return strtod(s,NULL);
+}
+
+int E();
+int term();
+
+/* the digits go to scan(), so does the exponent when it is an integer */
+
+int constant()
+{
+	char t[1100];
+	int n = 0, m = 0, q;
+	type k;
 	
 	while(c >= '0' && c <= '9') 
-		{ r = 10*r + (c-'0'); next(); }
+		{ if(n >= 1024) toolong(); t[n++] = c; next(); }
 	
 	if(c == '.')
 		{
-			type p = 0.1;
+			if(n >= 1024) toolong();
+			t[n++] = c;
 			next();
 			
 			while(c >= '0' && c <= '9') 
-				{ r += p * (c-'0'); p /= 10; next(); }
+				{ if(n >= 1024) toolong(); t[n++] = c; next(); }
 		}
 	
+	t[n] = 0;
+	
 	if(c == 'e' || c == 'E')
 		{ 
-			type m = 1;			
-
 			next();
-		  if(c == '-') { m = -m; next(); } else if(c == '+') next();
+		  if(c == '-') { m = 1; next(); } else if(c == '+') next();
 
-			r *= pow(10,m*term());
+			q = term();
+			k = m ? -reg[q] : reg[q];
+			
+			if(!konst[q] || k != floor(k) || fabs(k) > 1e6)
+				{
+					if(m) q = emit(SUB,0,q);
+					return emit(MUL,number(scan(t,t+n)),emit(POW,number(10),q));
+				}
+			
+			n += sprintf(t+n,"e%.0f",k);
 		}
 		
-	return r;
+	return number(scan(t,t+n));
 }
 
 
-type function()
+int function()
 {
 	char f[20], *p;
-	type v;
+	int i, v;
 	
 	p = f;
 	while(p-f < 19 && c >= 'a' && c <= 'z') { *p++ = c; next(); }
 	
 	*p = 0;
 	
-	if(!strcmp(f,"pi")) return M_PI;
-	if(!strcmp(f,"e" )) return M_E;
+	if(!strcmp(f,"pi")) return number(M_PI);
+	if(!strcmp(f,"e" )) return number(M_E);
 
-	v = term();
+	for(i=0;funcs[i].name;i++)
+		if(!strcmp(f,funcs[i].name)) return emit(FUNC,term(),i);
 	
-	#define mathfunc(a,b) if(!strcmp(f,a)) return b;
-
-	mathfunc("abs"   , fabs(v));
-	mathfunc("fabs"  , fabs(v));
-	mathfunc("floor" , floor(v));
-	mathfunc("ceil"  , ceil(v));
-	mathfunc("sqrt"  , sqrt(v));
-	mathfunc("exp"   , exp(v));
-
-	mathfunc("sin"   , sin(v));
-	mathfunc("cos"   , cos(v));
-	mathfunc("tan"   , tan(v));
-	mathfunc("asin"  , asin(v));
-	mathfunc("acos"  , acos(v));
-	mathfunc("atan"  , atan(v));
-
-	mathfunc("sinh"  , sinh(v));
-	mathfunc("cosh"  , cosh(v));
-	mathfunc("tanh"  , tanh(v));
-	mathfunc("asinh" , asinh(v));
-	mathfunc("acosh" , acosh(v));
-	mathfunc("atanh" , atanh(v));
+	/* anything else is a variable, assigning to it declares it */
+	
+	if(!(v = variable(f,c == '='))) { term(); unknown(f); }
+	
+	if(c == '=') { next(); i = emit(SET,E(),v); set[v] = 1; return i; }
+	
+	if(!set[v]) carry = 1; /* the value of the line before */
+	return v;
+}
 
-	mathfunc("ln"    , log(v));
-	mathfunc("log"   , log(v)/log(2));
+int column()
+{
+	int n = 0;
 	
-	unknown(f);
-	return 0;
+	next();
+	if(c < '1' || c > '9') syntax();
+	
+	while(c >= '0' && c <= '9')
+		{ n = 10*n + (c-'0'); if(n > MAXCOL) syntax(); next(); }
+	
+	if(!col[n]) col[n] = fresh(0);
+	if(n > ncol) ncol = n;
+	
+	return col[n];
 }
 
-type term()
+int term()
 {
-	/*type m = 1;*/
-	const int m = 1;
-		
-	/*
-	  if(c == '-') { m = -m; next(); }
-	  else 
-	  if(c == '+') next();
-	*/
-		
 	if(c=='(' || c=='[')
 		{
-			type r;
+			int r;
 			
 			next();
 			r = E();
 			if(c != ')' && c !=']') syntax();
 			
 			next();
-			return m * r;
+			return r;
 		}
 	
 	else if((c >= '0' && c <= '9') || c == '.')
-					return m * constant();
+					return constant();
 					
 	else if(c >= 'a' && c <= 'z')
-					return m * function();
+					return function();
+	
+	else if(c == '$')
+					return column();
+	
+	return 0;
 }
 
 
@@ -179,120 +589,715 @@ type factorial(type v)
 	return r;
 }
 
-type H()
+int H()
 {
-	type r = term();
+	int r = term();
 	
-	if(c == '!') { next(); r = factorial(r); }
+	if(c == '!') { next(); r = emit(FACT,r,0); }
 	return r;
 }
 
-type G()
+int G()
 {
-	type q, r = H();
+	int q, r = H();
 	
 	while(c == '^')
-		{ next(); q = G(); r = pow(r,q); }
+		{ next(); q = G(); r = emit(POW,r,q); }
 	
 	return r;
 }
 
-type F()
+int F()
 {
-	type r = G();
+	int r = G();
 
 	while(1)
 		{
-			if(c=='*') { next(); r *= G(); }
+			if(c=='*') { next(); r = emit(MUL,r,G()); }
 			else
-			if(c=='/') { next(); r /= G(); }
+			if(c=='/') { next(); r = emit(DIV,r,G()); }
 			else
-			if(c=='%') { next(); r = fmod(r,G()); }
+			if(c=='%') { next(); r = emit(MOD,r,G()); }
 			else break;
 		}
 	
 	return r;
 }
 
-type E()
+int E()
 {
-	type r = F();
+	int r = F();
 
 	while(1)
 		{
-			if(c=='+') { next(); r += F(); }
+			if(c=='+') { next(); r = emit(ADD,r,F()); }
 			else
-			if(c=='-') { next(); r -= F(); }
+			if(c=='-') { next(); r = emit(SUB,r,F()); }
 			else break;
 		}
 	
 	return r;
 }
 
-type S()
+int S()
 {
-	type r = E();
+	int r = E();
+	
+	while(c == ';') { next(); r = E(); }
 	
 	if(c != 0) syntax();
 	return r;
 }
 
-void
-format(type X)
+/* one instruction on constants, for the folding */
+
+type fold(int op, type x, type y, int f)
+{
+	switch(op)
+		{
+			case ADD : return x + y;
+			case SUB : return x - y;
+			case MUL : return x * y;
+			case DIV : return x / y;
+			case MOD : return fmod(x,y);
+			case POW : return pow(x,y);
+			case FACT: return factorial(x);
+			case FUNC: return funcs[f].f(x);
+		}
+	
+	return 0;
+}
+
+/* drops the code whose value is never used, assignments always stay */
+
+void prune()
 {
-	type i,f;
-	int d;
+	char live[MAXCODE];
+	code *i, *o;
+	
+	memset(live,0,sizeof(live));
+	live[result] = 1;
+	
+	for(i=body+ncode-1;i>=body;i--)
+		if(i->op == SET || live[i->d])
+			{
+				live[i->d] = live[i->a] = 1;
+				if(i->op < FACT) live[i->b] = 1;
+			}
 	
-	if(!finite(X)) { printf("%f", X); return ; }
+	for(i=o=body;i<body+ncode;i++)
+		if(i->op == SET || live[i->d]) *o++ = *i;
 	
-	f = fabs(modf(X,&i));
-	d = floor(log10(fabs(X)))+1;
+	ncode = o-body;
+}
 
-	/* f is fractional part, i is integer part */ 
-		
-	/* printf("%.30f\n",(X)); */
+/* one pass over the code, the registers hold the constants and the results */
+
+type interp()
+{
+	code *i, *end = body + ncode;
+	type *r = reg;
+	
+	for(i=body;i<end;i++)
+		switch(i->op)
+			{
+				case ADD : r[i->d] = r[i->a] + r[i->b]; break;
+				case SUB : r[i->d] = r[i->a] - r[i->b]; break;
+				case MUL : r[i->d] = r[i->a] * r[i->b]; break;
+				case DIV : r[i->d] = r[i->a] / r[i->b]; break;
+				case MOD : r[i->d] = fmod(r[i->a],r[i->b]); break;
+				case POW : r[i->d] = pow(r[i->a],r[i->b]); break;
+				case FACT: r[i->d] = factorial(r[i->a]); break;
+				case FUNC: r[i->d] = funcs[i->b].f(r[i->a]); break;
+				case SET : r[i->d] = r[i->b] = r[i->a]; break;
+			}
 	
-	if(finite(f) && f!=0)
+	return r[result];
+}
+
+/* native: the same pass as x86-64 code, the registers stay in memory at */
+/* rbx, libm is called through the table at r12, and xmm0 carries a result */
+/* on when the next instruction reads it */
+
+/* one and two argument functions alike, only the machine code calls them */
+
+typedef void (*entry)(void);
+
+entry calls[3 + sizeof(funcs)/sizeof(funcs[0])];
+
+void (*native)(type *, entry *);
+
+#ifdef NATIVE
+
+enum { LOAD = 0x10, STORE = 0x11, ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5c, DIVSD = 0x5e };
+
+const int arith[] = { ADDSD, SUBSD, MULSD, DIVSD };
+
+unsigned char *jp;
+
+void put(int x) { *jp++ = x; }
+void put32(int x) { memcpy(jp,&x,4); jp += 4; }
+
+/* op xmm0 or xmm1, [rbx + 8 r] */
+
+void sd(int op, int x, int r) { put(0xf2); put(0x0f); put(op); put(0x83 | x << 3); put32(8*r); }
+
+/* call [r12 + 8 f] */
+
+void call(int f) { put(0x41); put(0xff); put(0x94); put(0x24); put32(8*f); }
+
+void jit()
+{
+	size_t size = 64 + 32*ncode;
+	unsigned char *m;
+	code *i;
+	int f, held = -1;
+	
+	m = mmap(0,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if(m == MAP_FAILED) return;
+	
+	calls[0] = (entry)fmod; calls[1] = (entry)pow; calls[2] = (entry)factorial;
+	for(f=0;funcs[f].name;f++) calls[3+f] = (entry)funcs[f].f;
+	
+	jp = m;
+	put(0x53); put(0x41); put(0x54);            /* push rbx, push r12 */
+	put(0x48); put(0x83); put(0xec); put(0x08); /* sub rsp,8 */
+	put(0x48); put(0x89); put(0xfb);            /* mov rbx,rdi */
+	put(0x49); put(0x89); put(0xf4);            /* mov r12,rsi */
+	
+	for(i=body;i<body+ncode;i++)
 		{
-			char *p, s[2000], t[2000];
+			if(held != i->a) sd(LOAD,0,i->a);
 			
-			sprintf(t, "%%.%df", 15-d);
-			sprintf(s,t,f);
+			switch(i->op)
+				{
+					case ADD : 
+					case SUB :
+					case MUL :
+					case DIV : sd(arith[i->op],0,i->b); break;
+					case MOD : sd(LOAD,1,i->b); call(0); break;
+					case POW : sd(LOAD,1,i->b); call(1); break;
+					case FACT: call(2); break;
+					case FUNC: call(3 + i->b); break;
+					case SET : sd(STORE,0,i->b); break;
+				}
 			
-			/*
-			printf("(t=%s)",t);
-			printf("(s=%s)",s);
-			*/
+			sd(STORE,0,i->d);
+			held = i->d;
+		}
+	
+	put(0x48); put(0x83); put(0xc4); put(0x08); /* add rsp,8 */
+	put(0x41); put(0x5c); put(0x5b); put(0xc3); /* pop r12, pop rbx, ret */
+	
+	if(mprotect(m,size,PROT_READ|PROT_EXEC)) { munmap(m,size); return; }
+	
+	native = (void (*)(type *, entry *))m;
+}
+
+#else
+
+void jit() {}
 
+#endif
 
-			/* remove all zeros from s */
-			p = s; 
-			while(*p) p++; p--;
-			while(p>s && *p=='0') *p-- = 0; 
+/* the native code when there is, the interpreter otherwise */
+
+type run()
+{
+	if(!native) return interp();
+	
+	native(reg,calls);
+	return reg[result];
+}
+
+/* batch: the code runs instruction by instruction over BATCH rows at once, */
+/* each register is an aligned array, the loops below are vectorized and */
+/* cloned for AVX-512, AVX2 and plain SSE2, the best is picked at startup */
+
+#define BATCH 1024
+
+type *vec;
+
+#define V(r) (vec + (r)*BATCH)
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__clang__)
+#define CLONES __attribute__((target_clones("arch=x86-64-v4","arch=x86-64-v3","default")))
+#define KERNEL static inline __attribute__((always_inline))
+#else
+#define CLONES
+#define KERNEL static inline
+#endif
+
+/* x + SHIFT rounds x to an integer, kept in the low bits of the result */
+
+#define SHIFT 6755399441055744.0
+
+#define LN2HI 6.93147180369123816490e-01
+#define LN2LO 1.90821492927058770002e-10
+
+/* exp: x = n ln2 + r, |r| <= ln2/2, Taylor to r^13, within 1 ulp */
+/* outside [-708,709], NaN included, exp() itself */
+
+KERNEL void vexp(type *restrict d, const type *restrict a)
+{
+	int k;
+	
+	for(k=0;k<BATCH;k++)
+		{
+			int lo = a[k] > -708, hi = a[k] < 709;
+			type x = lo ? a[k] : -708;
+			type t, n, r, p;
+			
+			x = hi ? x : 709;
+			t = x*1.44269504088896338700 + SHIFT; n = t - SHIFT;
+			r = (x - n*LN2HI) - n*LN2LO;
+			p = 1/6227020800.0;
+			
+			p = 1/479001600.0 + r*p; p = 1/39916800.0 + r*p; p = 1/3628800.0 + r*p;
+			p = 1/362880.0 + r*p;    p = 1/40320.0 + r*p;    p = 1/5040.0 + r*p;
+			p = 1/720.0 + r*p;       p = 1/120.0 + r*p;      p = 1/24.0 + r*p;
+			p = 1/6.0 + r*p;         p = 0.5 + r*p;          p = 1 + r*p;
+			p = 1 + r*p;
 			
-			if(s[0] == '1') /* decimal part has been rounded */
-				printf("%.0f",i+(X>=0?1:-1));
+			d[k] = p * real((bits(t) << 52) + (1023ULL << 52));
+		}
+	
+	for(k=0;k<BATCH;k++)
+		if(!(a[k] > -708 && a[k] < 709)) d[k] = exp(a[k]);
+}
+
+/* ln: x = 2^n m, sqrt(1/2) <= m < sqrt(2), ln m = 2 atanh((m-1)/(m+1)) */
+/* by its series to s^23, within 2 ulp; zero, negative, subnormal, */
+/* infinite and NaN arguments go to log() */
+
+KERNEL void vln(type *restrict d, const type *restrict a)
+{
+	int k;
+	
+	for(k=0;k<BATCH;k++)
+		{
+			unsigned long long u = bits(a[k]);
+			type n = real(0x4330000000000000ULL | (u >> 52)) - 4503599627370496.0 - 1023;
+			type m = real((u & 0xfffffffffffffULL) | 0x3ff0000000000000ULL);
+			type h = m*0.5, n1 = n+1, s, z, p;
+			int big = m > 1.41421356237309504880;
+			
+			m = big ? h : m; n = big ? n1 : n;
+			
+			s = (m-1)/(m+1); z = s*s;
+			
+			p = 1/23.0;
+			p = 1/21.0 + z*p; p = 1/19.0 + z*p; p = 1/17.0 + z*p; p = 1/15.0 + z*p;
+			p = 1/13.0 + z*p; p = 1/11.0 + z*p; p = 1/9.0 + z*p;  p = 1/7.0 + z*p;
+			p = 1/5.0 + z*p;  p = 1/3.0 + z*p;
+			
+			d[k] = n*LN2HI + (n*LN2LO + (2*s + 2*s*z*p));
+		}
+	
+	for(k=0;k<BATCH;k++)
+		if(!(a[k] >= 2.2250738585072014e-308 && a[k] <= 1.7976931348623157e308)) d[k] = log(a[k]);
+}
+
+/* sin and cos: x = n pi/2 + r, |r| <= pi/4, pi/2 in 33 bit parts so that */
+/* n pi/2 is exact for |x| < 2^19, Taylor to r^17 and r^18, within 1.5 ulp */
+/* up to 10 and 2.5 ulp beyond, where r carries the error of the reduction */
+/* larger arguments and NaN go to sin() and cos() */
+
+#define PIO2_1 1.57079632673412561417e+00
+#define PIO2_2 6.07710050630396597660e-11
+#define PIO2_3 2.02226624871116645580e-21
+#define PIO2_T 8.47842766036889956997e-32
+
+KERNEL void vsin(type *restrict d, const type *restrict a, int cosine)
+{
+	int k;
+	
+	for(k=0;k<BATCH;k++)
+		{
+			type x = fabs(a[k]) < 524288 ? a[k] : 0;
+			type t = x*6.36619772367581382433e-01 + SHIFT, n = t - SHIFT;
+			type r = ((x - n*PIO2_1) - n*PIO2_2) - (n*PIO2_3 + n*PIO2_T), z = r*r;
+			unsigned long long q = bits(t) + cosine;
+			type s, c;
+			
+			s = -1/355687428096000.0;
+			s = 1/1307674368000.0 + z*s; s = -1/6227020800.0 + z*s; s = 1/39916800.0 + z*s;
+			s = -1/362880.0 + z*s;       s = 1/5040.0 + z*s;        s = -1/120.0 + z*s;
+			s = 1/6.0 + z*s;
+			s = r - r*z*s;
+			
+			c = 1/6402373705728000.0;
+			c = -1/20922789888000.0 + z*c; c = 1/87178291200.0 + z*c; c = -1/479001600.0 + z*c;
+			c = 1/3628800.0 + z*c;         c = -1/40320.0 + z*c;      c = 1/720.0 + z*c;
+			c = -1/24.0 + z*c;             c = 0.5 + z*c;
+			c = 1 - z*c;
+			
+			s = q & 1 ? c : s;
+			d[k] = q & 2 ? -s : s;
+		}
+	
+	for(k=0;k<BATCH;k++)
+		if(!(fabs(a[k]) < 524288)) d[k] = cosine ? cos(a[k]) : sin(a[k]);
+}
+
+CLONES
+void vfunc(type *restrict d, const type *restrict a, int f)
+{
+	int k;
+	
+	switch(funcs[f].v)
+		{
+			case VABS  : for(k=0;k<BATCH;k++) d[k] = fabs(a[k]); break;
+			case VFLOOR: for(k=0;k<BATCH;k++) d[k] = floor(a[k]); break;
+			case VCEIL : for(k=0;k<BATCH;k++) d[k] = ceil(a[k]); break;
+			case VSQRT : for(k=0;k<BATCH;k++) d[k] = a[k] >= 0 ? __builtin_sqrt(a[k]) : sqrt(a[k]); break;
+			case VEXP  : vexp(d,a); break;
+			case VSIN  :
+			case VCOS  : vsin(d,a,funcs[f].v == VCOS); break;
+			case VLN   :
+			case VLOG  :
+				vln(d,a);
+				if(funcs[f].v == VLOG) for(k=0;k<BATCH;k++) d[k] /= 6.93147180559945309417e-01;
+				break;
+			default    : for(k=0;k<BATCH;k++) d[k] = funcs[f].f(a[k]);
+		}
+}
+
+#define EACH(x) for(k=0;k<BATCH;k++) d[k] = x; break
+
+CLONES
+void vop(int op, type *restrict d, const type *restrict a, const type *restrict b)
+{
+	int k;
+	
+	switch(op)
+		{
+			case ADD : EACH(a[k] + b[k]);
+			case SUB : EACH(a[k] - b[k]);
+			case MUL : EACH(a[k] * b[k]);
+			case DIV : EACH(a[k] / b[k]);
+			case MOD : EACH(fmod(a[k],b[k]));
+			case POW : EACH(pow(a[k],b[k]));
+			case FACT: EACH(factorial(a[k]));
+		}
+}
+
+void runv()
+{
+	code *i, *end = body + ncode;
+	
+	for(i=body;i<end;i++)
+		if(i->op == FUNC) vfunc(V(i->d),V(i->a),i->b);
+		else
+		if(i->op == SET)
+			{
+				if(i->a != i->b) memcpy(V(i->b),V(i->a),BATCH*sizeof(type));
+				memcpy(V(i->d),V(i->a),BATCH*sizeof(type));
+			}
+		else
+			vop(i->op,V(i->d),V(i->a),V(i->b));
+}
+
+/* output: the shortest digits that read back as X (Ryu), or with -fN, */
+/* -eN and -gN fixed, scientific or N significant digits as printf has them */
+
+char mode;
+int prec;
+
+/* (m f) >> j for the 128 bit f, 64 < j < 128 */
+
+static inline unsigned long long shift(unsigned long long m, unsigned long long *f, int j)
+{
+	unsigned long long lo0, hi0 = mul(m,f[0],&lo0), lo2, hi2 = mul(m,f[1],&lo2);
+	
+	lo2 += hi0; hi2 += lo2 < hi0;
+	return hi2 << (128-j) | lo2 >> (j-64);
+}
+
+static inline int fives(unsigned long long v)
+{
+	int n = 0;
+	
+	while(v % 5 == 0) { v /= 5; n++; }
+	return n;
+}
+
+/* the shortest d 10^e in the rounding interval of the positive double u, */
+/* the closest one when there are several, returns e */
+
+int ryu(unsigned long long u, unsigned long long *d)
+{
+	unsigned long long m2, mv, vr, vp, vm, f = u & ((1ULL << 52) - 1);
+	int e2, q, i, e10, even, mm, vmz = 0, vrz = 0, last = 0, up = 0;
+	
+	if(!ready) tables();
+	
+	if(u >> 52) { e2 = (int)(u >> 52) - 1023 - 52 - 2; m2 = 1ULL << 52 | f; }
+	else { e2 = 1 - 1023 - 52 - 2; m2 = f; }
+	
+	even = !(m2 & 1);
+	mv = 4*m2;
+	mm = f != 0 || u >> 52 <= 1;
+	
+	/* mv, mv+2 and mv-1-mm scaled to 10^e10, knowing whether the */
+	/* digits dropped on the way were all zeros */
+	
+	if(e2 >= 0)
+		{
+			q = ((e2 * 78913) >> 18) - (e2 > 3);
+			e10 = q;
+			i = -e2 + q + 125 + pow5bits(q) - 1;
+			vr = shift(mv,inv5[q],i); vp = shift(mv+2,inv5[q],i); vm = shift(mv-1-mm,inv5[q],i);
+			
+			if(q <= 21)
+				{
+					if(mv % 5 == 0) vrz = fives(mv) >= q;
+					else if(even) vmz = fives(mv-1-mm) >= q;
+					else vp -= fives(mv+2) >= q;
+				}
+		}
+	else
+		{
+			q = ((-e2 * 732923) >> 20) - (-e2 > 1);
+			e10 = q + e2;
+			i = -e2 - q;
+			vr = shift(mv,pow5[i],q-pow5bits(i)+125);
+			vp = shift(mv+2,pow5[i],q-pow5bits(i)+125);
+			vm = shift(mv-1-mm,pow5[i],q-pow5bits(i)+125);
+			
+			if(q <= 1)
+				{
+					vrz = 1;
+					if(even) vmz = mm; else vp--;
+				}
+			else if(q < 63) vrz = !(mv & ((1ULL << q) - 1));
+		}
+	
+	/* drop digits while the interval still holds a shorter number */
+	
+	if(vmz || vrz)
+		{
+			while(vp/10 > vm/10)
+				{
+					vmz &= vm % 10 == 0;
+					vrz &= last == 0;
+					last = vr % 10;
+					vr /= 10; vp /= 10; vm /= 10; e10++;
+				}
+			
+			if(vmz)
+				while(vm % 10 == 0)
+					{
+						vrz &= last == 0;
+						last = vr % 10;
+						vr /= 10; vp /= 10; vm /= 10; e10++;
+					}
+			
+			if(vrz && last == 5 && vr % 2 == 0) last = 4;
+			*d = vr + ((vr == vm && (!even || !vmz)) || last >= 5);
+		}
+	else
+		{
+			if(vp/100 > vm/100)
+				{
+					up = vr % 100 >= 50;
+					vr /= 100; vp /= 100; vm /= 100; e10 += 2;
+				}
+			
+			while(vp/10 > vm/10)
+				{
+					up = vr % 10 >= 5;
+					vr /= 10; vp /= 10; vm /= 10; e10++;
+				}
+			
+			*d = vr + (vr == vm || up);
+		}
+	
+	return e10;
+}
+
+/* writes X to o, returns the length; plain notation for 1e-6 <= |X| < 1e21 */
+
+int format(char *o, type X)
+{
+	unsigned long long u = bits(X), d;
+	char t[20], *s = o, *g;
+	int n, e, point;
+	
+	if(mode) return sprintf(o, mode == 'f' ? "%.*f" : mode == 'e' ? "%.*e" : "%.*g", prec, X);
+	if(!isfinite(X)) return sprintf(o, "%f", X);
+	
+	if(u >> 63) *s++ = '-';
+	u &= ~(1ULL << 63);
+	
+	if(X == 0) { *s++ = '0'; *s = 0; return s-o; }
+	
+	if(fabs(X) < 9007199254740992.0 && X == (long long)X) { d = fabs(X); e = 0; }
+	else e = ryu(u,&d);
+	
+	for(g=t+20;d;d/=10) *--g = '0' + d%10;
+	n = t+20-g;
+	point = n + e;
+	
+	if(point > -6 && point <= 21)
+		{
+			if(point <= 0)
+				{
+					*s++ = '0'; *s++ = '.';
+					while(point++ < 0) *s++ = '0';
+					memcpy(s,g,n); s += n;
+				}
+			else if(point < n)
+				{
+					memcpy(s,g,point); s += point;
+					*s++ = '.';
+					memcpy(s,g+point,n-point); s += n-point;
+				}
 			else
-				{			
-					printf("%.0f",i);
-					if(s[2] != 0) printf("%s",s+1);
+				{
+					memcpy(s,g,n); s += n;
+					while(n++ < point) *s++ = '0';
 				}
 		}
 	else
-		printf("%.0f",i);
+		{
+			*s++ = *g;
+			if(n > 1) { *s++ = '.'; memcpy(s,g+1,n-1); s += n-1; }
+			s += sprintf(s,"e%d",point-1);
+		}
+	
+	*s = 0;
+	return s-o;
+}
+
+/* streaming: one evaluation per line of standard input */
+
+#define BLOCK 65536
+
+char out[BLOCK];
+int nout;
+
+void flush()
+{
+	int n, w;
+	
+	for(w=0;w<nout;w+=n)
+		if((n = write(1,out+w,nout-w)) < 0)
+			{
+				if(errno == EINTR) n = 0; else exit(1);
+			}
+	
+	nout = 0;
+}
+
+void print(type X)
+{
+	if(nout > BLOCK-4096) flush();
+	
+	nout += format(out+nout,X);
+	out[nout++] = '\n';
+}
+
+int rows;
+
+void drain()
+{
+	int k;
+	
+	runv();
+	for(k=0;k<rows;k++) print(V(result)[k]);
+	
+	rows = 0;
+}
+
+/* fields are separated by blanks or by a comma, missing fields are 0 */
+/* a batch collects them by column, otherwise every line runs on its own */
+
+void line(char *s)
+{
+	int k;
+	char *t;
+	
+	for(k=1;k<=ncol;k++)
+		{
+			while(*s == ' ' || *s == '\t' || *s == '\r') s++;
+			
+			t = s;
+			while(*s != '\n' && *s != ',' && *s != ' ' && *s != '\t' && *s != '\r') s++;
+			if(col[k]) *(vec ? V(col[k]) + rows : reg + col[k]) = scan(t,s);
+			
+			while(*s == ' ' || *s == '\t' || *s == '\r') s++;
+			if(*s == ',') s++;
+		}
+	
+	if(!vec) print(run());
+	else
+	if(++rows == BATCH) drain();
+}
 
+void stream()
+{
+	int size = BLOCK, have = 0, n, eof = 0, k;
+	char *in = malloc(size+1), *s, *t;
+	
+	/* rows can be batched unless a variable carries over from line to line */
+	
+	if(!carry && (vec = aligned_alloc(64,nreg*BATCH*sizeof(type))))
+		for(n=0;n<nreg;n++)
+			for(k=0;k<BATCH;k++) V(n)[k] = reg[n];
+	
+	if(!vec) jit();
+	
+	while(!eof)
+		{
+			if(!in) { printf("out of memory\n"); exit(1); }
+			
+			n = read(0,in+have,size-have);
+			if(n < 0 && errno == EINTR) continue;
+			if(n < 0) { perror("e"); exit(1); }
+			
+			if(n == 0) { eof = 1; if(have) in[have++] = '\n'; }
+			have += n;
+			
+			for(s=in;(t = memchr(s,'\n',in+have-s));s=t+1) line(s);
+			
+			have -= s-in;
+			memmove(in,s,have);
+			
+			if(have == size) in = realloc(in,(size *= 2)+1);
+		}
+	
+	if(rows) drain();
+	flush();
 }
 
 int main(int _argc, char **_argv)
 {
+	char s[4096], *o;
+	
 	argc = _argc;
 	argv = _argv;
 	arg = 1;
+	
+	/* -f3, -e3, -g3 set the output format, no expression starts that */
+	/* way though a bare -e is one */
+	
+	while(arg < argc && (o = argv[arg])[0] == '-' && o[1] && strchr("feg",o[1])
+		&& o[2] >= '0' && o[2] <= '9' && (!o[3] || (o[3] >= '0' && o[3] <= '9' && !o[4])))
+		{ mode = o[1]; prec = atoi(o+2); argc--; argv++; }
+	
 	p = argv[arg];
 	
+	number(0);
+	
 	next();
-	format(S());	
-	printf("\n");
+	result = S();
+	prune();
+	
+	if(ncol) { stream(); return 0; }
+	
+	format(s,run());
+	printf("%s\n",s);
 	
 	return 0;
 }
@@ -0,0 +1,68 @@
+#!/bin/sh
+
+# times since on synthetic logs, prints csv on standard output
+# invoked by make bench, which passes the parameters below
+
+DIR=${BENCH_DIR:-/tmp/since-bench}
+FILES=${BENCH_FILES:-10}
+SIZE=${BENCH_SIZE:-16M}
+LINE=${BENCH_LINE:-100}
+RATE=${BENCH_RATE:-1000}
+RECORDS=${BENCH_RECORDS:-"10 10000 1000000"}
+ENGINES=${BENCH_ENGINES:-"read mmap splice uring"}
+
+SINCE=./since
+LOGGEN=./loggen
+
+now(){
+  date +%s.%N
+}
+
+elapsed(){
+  echo "$1 $(now)" | awk '{ printf "%.6f", $2 - $1 }'
+}
+
+row(){
+  echo "$1,$2,$FILES,$3,$4,$5"
+}
+
+mkdir -p "$DIR" || exit 1
+rm -f "$DIR"/log.* "$DIR"/state.*
+
+$LOGGEN -d "$DIR" -n $FILES -s $SIZE -l $LINE || exit 1
+BYTES=$(cat "$DIR"/log.* | wc -c)
+
+echo "benchmark,engine,files,bytes,records,seconds"
+
+# catch up on everything, output through a pipe so that splice applies
+for engine in $ENGINES ; do
+  $LOGGEN -d "$DIR" -n $FILES -e
+  start=$(now)
+  $SINCE -q -n -s "$DIR/state.none" --engine $engine "$DIR"/log.* | cat > /dev/null
+  row catchup-cold $engine $BYTES 0 $(elapsed $start)
+
+  start=$(now)
+  $SINCE -q -n -s "$DIR/state.none" --engine $engine "$DIR"/log.* | cat > /dev/null
+  row catchup-warm $engine $BYTES 0 $(elapsed $start)
+done
+
+# state file load and lookup, -z skips the output
+for records in $RECORDS ; do
+  $LOGGEN -d "$DIR" -n $FILES -S $records -o "$DIR/state.$records" || exit 1
+  start=$(now)
+  $SINCE -q -n -z -s "$DIR/state.$records" "$DIR"/log.*
+  row state-lookup - 0 $records $(elapsed $start)
+done
+
+# mean delay between change notification and output while following
+: > "$DIR/state.follow"
+$SINCE -q -z -f --delay -s "$DIR/state.follow" "$DIR/log.0" > "$DIR/follow.out" &
+pid=$!
+sleep 1
+$LOGGEN -d "$DIR" -n 1 -a -r $RATE -t 3 -l $LINE
+sleep 1
+kill -INT $pid
+wait $pid
+echo follow-latency,-,1,$(wc -c < "$DIR/follow.out"),0,$(awk '/^\+/ { sum += substr($1, 2); n++ } END { if(n > 0) printf "%.6f", sum / n; else print "" }' "$DIR/follow.out")
+
+rm -f "$DIR"/log.* "$DIR"/state.* "$DIR/follow.out"
@@ -0,0 +1,41 @@
+#!/bin/sh
+
+# checks since on small crafted logs, invoked by make check
+
+DIR=${CHECK_DIR:-/tmp/since-check}
+SINCE=./since
+
+FAILED=0
+
+check(){
+  if [ "$2" = "$3" ] ; then
+    printf 'ok   %s\n' "$1"
+  else
+    printf 'FAIL %s\n  expected: %s\n  got:      %s\n' "$1" "$2" "$3"
+    FAILED=1
+  fi
+}
+
+mkdir -p "$DIR" || exit 1
+rm -f "$DIR"/log "$DIR"/state
+
+# json output is valid UTF-8, whatever the bytes of the log
+printf 'caf\303\251 \342\202\254\n' > "$DIR/log"
+printf 'latin-1 caf\351 and a cut off \342\202\n' >> "$DIR/log"
+printf 'quote " backslash \\ tab \t\n' >> "$DIR/log"
+
+$SINCE -q -s "$DIR/state" --json "$DIR/log" | sed 's/"inode":[0-9]*,//' > "$DIR/out"
+
+check "json utf-8 passed through" \
+  "{\"file\":\"$DIR/log\",\"offset\":0,\"line\":1,\"text\":\"$(printf 'caf\303\251 \342\202\254')\"}" \
+  "$(sed -n 1p "$DIR/out")"
+check "json invalid bytes escaped" \
+  "{\"file\":\"$DIR/log\",\"offset\":10,\"line\":2,\"text\":\"latin-1 caf\\u00e9 and a cut off \\u00e2\\u0082\"}" \
+  "$(sed -n 2p "$DIR/out")"
+check "json quotes, backslashes and controls escaped" \
+  "{\"file\":\"$DIR/log\",\"offset\":40,\"line\":3,\"text\":\"quote \\\" backslash \\\\ tab \\t\"}" \
+  "$(sed -n 3p "$DIR/out")"
+
+rm -f "$DIR"/log "$DIR"/state "$DIR"/out
+
+exit $FAILED
@@ -0,0 +1,372 @@
+/* synthetic log files and state files, used by make bench */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sysexits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define MAX_LINE 65536
+#define MAX_PATH 4096
+
+struct gen_state{
+  char *g_dir;
+  int g_files;
+  unsigned long long g_size;
+  int g_length;
+  int g_rate;
+  int g_time;
+  int g_append;
+  int g_evict;
+  unsigned long g_records;
+  char *g_output;
+  unsigned long long g_seq;
+  unsigned int g_seed;
+};
+
+static char *words[] = { "session", "opened", "closed", "for", "user", "root", "connection", "from", "port", "accepted", "failed", "password", "timeout", "request", "GET", "POST", "/index.html", "200", "404", "500", "bytes", "kernel:", "eth0", "link", "up", "down", NULL };
+
+static unsigned long long parse_size(char *param)
+{
+  char *end;
+  unsigned long long value;
+
+  value = strtoull(param, &end, 10);
+  switch(*end){
+    case 'g' : case 'G' :
+      value *= 1024;
+    case 'm' : case 'M' :
+      value *= 1024;
+    case 'k' : case 'K' :
+      value *= 1024;
+      end++;
+      break;
+  }
+
+  return (*end == '\0') ? value : 0;
+}
+
+static void file_name(struct gen_state *gs, char *target, int i)
+{
+  snprintf(target, MAX_PATH, "%s/log.%d", gs->g_dir, i);
+}
+
+/* a syslog style line of roughly the requested length, always distinct */
+static int make_line(struct gen_state *gs, char *target)
+{
+  struct tm tm;
+  time_t now;
+  int len, want, w;
+
+  want = gs->g_length / 2 + (rand_r(&(gs->g_seed)) % (gs->g_length + 1));
+  if(want >= MAX_LINE){
+    want = MAX_LINE - 1;
+  }
+
+  now = time(NULL);
+  localtime_r(&now, &tm);
+  len = strftime(target, MAX_LINE, "%b %d %H:%M:%S", &tm);
+  len += snprintf(target + len, MAX_LINE - len, " bench loggen[%llu]:", gs->g_seq++);
+
+  while(len < want){
+    for(w = 0; words[w]; w++);
+    len += snprintf(target + len, MAX_LINE - len, " %s", words[rand_r(&(gs->g_seed)) % w]);
+  }
+  if(len > want){
+    len = (want > 0) ? want : 1;
+  }
+
+  target[len - 1] = '\n';
+
+  return len;
+}
+
+static int write_all(int fd, char *buffer, int len)
+{
+  int wr, wt;
+
+  for(wt = 0; wt < len; wt += wr){
+    wr = write(fd, buffer + wt, len - wt);
+    if(wr < 0){
+      if(errno == EINTR){
+        wr = 0;
+        continue;
+      }
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int create_files(struct gen_state *gs)
+{
+  char name[MAX_PATH], line[MAX_LINE], *buffer;
+  unsigned long long have;
+  int i, fd, len, used;
+
+  buffer = malloc(MAX_LINE * 16);
+  if(buffer == NULL){
+    fprintf(stderr, "loggen: unable to allocate buffer\n");
+    return -1;
+  }
+
+  for(i = 0; i < gs->g_files; i++){
+    file_name(gs, name, i);
+    fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+      fprintf(stderr, "loggen: unable to create %s: %s\n", name, strerror(errno));
+      free(buffer);
+      return -1;
+    }
+
+    used = 0;
+    for(have = 0; have < gs->g_size; have += len){
+      len = make_line(gs, line);
+      if((used + len) > (MAX_LINE * 16)){
+        if(write_all(fd, buffer, used)){
+          fprintf(stderr, "loggen: unable to write %s: %s\n", name, strerror(errno));
+          close(fd);
+          free(buffer);
+          return -1;
+        }
+        used = 0;
+      }
+      memcpy(buffer + used, line, len);
+      used += len;
+    }
+
+    if(write_all(fd, buffer, used)){
+      fprintf(stderr, "loggen: unable to write %s: %s\n", name, strerror(errno));
+      close(fd);
+      free(buffer);
+      return -1;
+    }
+
+    close(fd);
+  }
+
+  free(buffer);
+
+  return 0;
+}
+
+/* append lines round robin at the given rate, one write per line */
+static int append_files(struct gen_state *gs)
+{
+  char name[MAX_PATH], line[MAX_LINE];
+  struct timespec start, now, pause;
+  unsigned long long count, due;
+  int *fds, i, len;
+
+  fds = malloc(sizeof(int) * gs->g_files);
+  if(fds == NULL){
+    return -1;
+  }
+
+  for(i = 0; i < gs->g_files; i++){
+    file_name(gs, name, i);
+    fds[i] = open(name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fds[i] < 0){
+      fprintf(stderr, "loggen: unable to open %s: %s\n", name, strerror(errno));
+      return -1;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for(count = 0;; count++){
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if((now.tv_sec - start.tv_sec) >= gs->g_time){
+      break;
+    }
+
+    due = ((now.tv_sec - start.tv_sec) * 1000000000ULL + now.tv_nsec - start.tv_nsec) * gs->g_rate / 1000000000ULL;
+    if(count > due){
+      pause.tv_sec = 0;
+      pause.tv_nsec = 1000000000 / gs->g_rate;
+      nanosleep(&pause, NULL);
+    }
+
+    len = make_line(gs, line);
+    if(write_all(fds[count % gs->g_files], line, len)){
+      fprintf(stderr, "loggen: unable to append: %s\n", strerror(errno));
+      return -1;
+    }
+  }
+
+  for(i = 0; i < gs->g_files; i++){
+    close(fds[i]);
+  }
+  free(fds);
+
+  return 0;
+}
+
+/* drop the files from the page cache, so that the next read is cold */
+static int evict_files(struct gen_state *gs)
+{
+  char name[MAX_PATH];
+  int i, fd;
+
+  for(i = 0; i < gs->g_files; i++){
+    file_name(gs, name, i);
+    fd = open(name, O_RDONLY);
+    if(fd < 0){
+      fprintf(stderr, "loggen: unable to open %s: %s\n", name, strerror(errno));
+      return -1;
+    }
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+  }
+
+  return 0;
+}
+
+/* records in the layout since uses on this architecture, the generated files last */
+static int write_state(struct gen_state *gs)
+{
+  char name[MAX_PATH];
+  struct stat st;
+  unsigned long i;
+  FILE *fp;
+  time_t now;
+
+  fp = fopen(gs->g_output, "w");
+  if(fp == NULL){
+    fprintf(stderr, "loggen: unable to create %s: %s\n", gs->g_output, strerror(errno));
+    return -1;
+  }
+
+  now = time(NULL);
+
+  for(i = 0; i < gs->g_records; i++){
+    fprintf(fp, "%016llx:%016llx:%016llx:%016llx:%016llx:%016llx:%016llx\n",
+      0xfffeULL, 0x100000000ULL + i, (unsigned long long)(rand_r(&(gs->g_seed)) % 1000000), (unsigned long long)now, 0ULL, 0ULL, 0ULL);
+  }
+
+  for(i = 0; i < gs->g_files; i++){
+    file_name(gs, name, i);
+    if(stat(name, &st)){
+      fprintf(stderr, "loggen: unable to stat %s: %s\n", name, strerror(errno));
+      fclose(fp);
+      return -1;
+    }
+    fprintf(fp, "%016llx:%016llx:%016llx:%016llx:%016llx:%016llx:%016llx\n",
+      (unsigned long long)(st.st_dev), (unsigned long long)(st.st_ino), 0ULL, (unsigned long long)now, 0ULL, 0ULL, 0ULL);
+  }
+
+  if(fclose(fp)){
+    fprintf(stderr, "loggen: unable to write %s: %s\n", gs->g_output, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static void usage(char *app)
+{
+  printf("loggen generates log files and since state files for benchmarks\n\n");
+
+  printf("Usage: %s [option ...]\n", app);
+
+  printf("\nOptions\n");
+  printf(" -d dir    directory holding the files log.0, log.1, ...\n");
+  printf(" -n int    number of files\n");
+  printf(" -s size   size of each file, with optional k, M or G suffix\n");
+  printf(" -l int    average line length\n");
+  printf(" -a        append to the files instead of creating them\n");
+  printf(" -r int    lines per second to append\n");
+  printf(" -t int    seconds to keep appending\n");
+  printf(" -e        evict the files from the page cache\n");
+  printf(" -S int    write a state file with the given number of unrelated records\n");
+  printf(" -o file   name of the state file\n");
+  printf(" -h        this help\n");
+}
+
+int main(int argc, char *argv[])
+{
+  struct gen_state state, *gs;
+  int c;
+
+  gs = &state;
+
+  gs->g_dir = ".";
+  gs->g_files = 1;
+  gs->g_size = 1024 * 1024;
+  gs->g_length = 100;
+  gs->g_rate = 1000;
+  gs->g_time = 5;
+  gs->g_append = 0;
+  gs->g_evict = 0;
+  gs->g_records = 0;
+  gs->g_output = NULL;
+  gs->g_seq = 0;
+  gs->g_seed = 1;
+
+  while((c = getopt(argc, argv, "d:n:s:l:ar:t:eS:o:h")) != -1){
+    switch(c){
+      case 'd' :
+        gs->g_dir = optarg;
+        break;
+      case 'n' :
+        gs->g_files = atoi(optarg);
+        break;
+      case 's' :
+        gs->g_size = parse_size(optarg);
+        break;
+      case 'l' :
+        gs->g_length = atoi(optarg);
+        break;
+      case 'a' :
+        gs->g_append = 1;
+        break;
+      case 'r' :
+        gs->g_rate = atoi(optarg);
+        break;
+      case 't' :
+        gs->g_time = atoi(optarg);
+        break;
+      case 'e' :
+        gs->g_evict = 1;
+        break;
+      case 'S' :
+        gs->g_records = strtoul(optarg, NULL, 10);
+        break;
+      case 'o' :
+        gs->g_output = optarg;
+        break;
+      case 'h' :
+        usage(argv[0]);
+        return EX_OK;
+      default :
+        return EX_USAGE;
+    }
+  }
+
+  if((gs->g_files <= 0) || (gs->g_length <= 1) || (gs->g_rate <= 0)){
+    fprintf(stderr, "loggen: file count, line length and rate need to be positive\n");
+    return EX_USAGE;
+  }
+
+  if(gs->g_output){
+    return write_state(gs) ? EX_CANTCREAT : EX_OK;
+  }
+
+  if(gs->g_evict){
+    return evict_files(gs) ? EX_OSERR : EX_OK;
+  }
+
+  if(gs->g_append){
+    return append_files(gs) ? EX_IOERR : EX_OK;
+  }
+
+  return create_files(gs) ? EX_CANTCREAT : EX_OK;
+}
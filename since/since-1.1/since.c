@@ -1,5 +1,8 @@
 /* (c) 1998 - 2009 Marc Welz */
 
+/* for strptime */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -12,13 +15,26 @@
 #include <signal.h>
 #include <time.h>
 #include <pwd.h>
+#include <dirent.h>
+#include <regex.h>
+#include <pthread.h>
 
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <poll.h>
 #ifdef USE_INOTIFY
 #include <sys/inotify.h>
 #endif
+#ifdef USE_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 /* for embedded or broken systems where no home exists */
 #define SINCE_FALLBACK "/tmp/since"
@@ -27,11 +43,114 @@
 #define SINCE_MASK (S_IWUSR | S_IRUSR | S_IWGRP | S_IRGRP)
 
 /* max format/data string */
-#define MAX_FMT 100
+#define MAX_FMT 160
 
 /* number of chars to search back for a newline */
 #define LINE_SEARCH 160
 
+/* fields of a state file record, in the order they appear on disk */
+#define FIELD_DEVICE 0
+#define FIELD_INODE  1
+#define FIELD_SIZE   2
+#define FIELD_SEEN   3
+#define FIELD_HEAD   4
+#define FIELD_TAIL   5
+#define FIELD_LINE   6
+#define FIELD_COUNT  7
+/* files written by older versions only have device, inode and size */
+#define FIELD_MIN    3
+
+/* only refresh the last seen stamp of an unchanged record this often */
+#define SEEN_SLACK 3600
+
+/* content fingerprints: hash of the start of a file, and of the bytes before the saved offset */
+#define PRINT_HEAD 4096
+#define PRINT_TAIL 256
+
+/* staging area and vector for line oriented output */
+#define OUTPUT_BUFFER (256 * 1024)
+#ifdef IOV_MAX
+#define OUTPUT_VECTOR IOV_MAX
+#else
+#define OUTPUT_VECTOR 1024
+#endif
+#define OUTPUT_MARKS 4096
+/* clean runs at least this long are written from the source, not copied */
+#define OUTPUT_SLICE 1024
+/* raw data up to this size is copied into the output batch, more is written directly */
+#define OUTPUT_GATHER (OUTPUT_BUFFER / 4)
+
+/* optional per line prefixes */
+#define PREFIX_TIME  0x1
+#define PREFIX_DELAY 0x2
+#define PREFIX_TAG   0x4
+
+/* aggregation instead of output */
+#define COUNT_TOTAL  0x1
+#define COUNT_MINUTE 0x2
+
+/* read buffers start small and double while reads fill them */
+#define READ_START (64 * 1024)
+#define READ_MAX (4 * 1024 * 1024)
+/* below this it is cheaper to copy than to set up a mapping or splice */
+#define MAP_MIN READ_START
+#define SPLICE_MIN READ_START
+/* how far ahead to ask the kernel to read */
+#define ADVISE_AHEAD (16 * 1024 * 1024)
+
+#define ENGINE_AUTO   0
+#define ENGINE_READ   1
+#define ENGINE_MMAP   2
+#define ENGINE_SPLICE 3
+#define ENGINE_URING  4
+
+/* timed phases and counted system calls of --profile */
+#define PROF_OPEN    0
+#define PROF_LOAD    1
+#define PROF_CHECK   2
+#define PROF_LOOKUP  3
+#define PROF_DISPLAY 4
+#define PROF_OUTPUT  5
+#define PROF_UPDATE  6
+#define PROF_TOTAL   7
+#define PROF_SPANS   8
+
+#define PROF_READ    0
+#define PROF_PREAD   1
+#define PROF_WRITE   2
+#define PROF_WRITEV  3
+#define PROF_SPLICE  4
+#define PROF_MMAP    5
+#define PROF_LSEEK   6
+#define PROF_STAT    7
+#define PROF_URING   8
+#define PROF_CALLS   9
+
+/* all instrumentation is behind a single test when disabled */
+#define PROF_BEGIN(sn, t) do { if((sn)->s_profile){ clock_gettime(CLOCK_MONOTONIC, &(t)); } } while(0)
+#define PROF_END(sn, t, span) do { if((sn)->s_profile){ prof_span((sn), &(t), (span)); } } while(0)
+#define PROF_CALL(sn, call) do { if((sn)->s_profile){ (sn)->s_prof.p_calls[call]++; } } while(0)
+
+/* with at least START_SERIAL files, start-up opens them with this many threads */
+#define START_THREADS 16
+#define START_SERIAL  8
+
+/* when polling, a file which grew is checked this many times per -d interval, an idle one backs off to this many intervals */
+#define POLL_FAST 8
+#define POLL_SLOW 16
+
+/* highest column --fields can pick */
+#define PICK_MAX 1024
+
+/* reads kept in flight by the io_uring reader, each of a chunk */
+#define RING_DEPTH 16
+#define RING_CHUNK (128 * 1024)
+/* room in front of a chunk for the incomplete line of the previous one */
+#define RING_CARRY (64 * 1024)
+
+/* default amount of data handed to a downstream command per commit */
+#define EXEC_BATCH (1024 * 1024)
+
 /* this is used to compute a valid offset for mmapping data files */
 /* apparently one should use getpagesize() instead */
 #ifdef PAGE_SIZE
@@ -45,14 +164,64 @@ struct fmt_map{
   char *f_string;
 };
 
+struct inode_key{
+  dev_t i_dev;
+  ino_t i_ino;
+};
+
+struct count_bin{
+  time_t b_minute;
+  unsigned long long b_lines;
+  unsigned long long b_matches;
+};
+
+struct dedup_entry{
+  unsigned long long e_key;
+  int e_prev;
+  int e_next;
+  int e_chain;
+};
+
+/* lru of recently seen line hashes, chained hash table over an array */
+struct dedup_cache{
+  struct dedup_entry *c_entries;
+  int *c_heads;
+  unsigned int c_mask;
+  unsigned int c_used;
+  unsigned int c_size;
+  int c_first;
+  int c_last;
+};
+
 struct data_file{
   int d_fd;
   char *d_name;
   dev_t d_dev;
   ino_t d_ino;
+  time_t d_seen;
+  unsigned long long d_head;
+  unsigned long long d_tail;
+  off_t d_head_len;
   off_t d_had;
   off_t d_now;
   off_t d_pos;
+  off_t d_lines;
+  char *d_json;
+  unsigned int d_json_len;
+  struct timespec d_event;
+  unsigned long long d_count_lines;
+  unsigned long long d_count_bytes;
+  unsigned long long d_count_matches;
+  struct count_bin *d_bins;
+  unsigned int d_bin_count;
+  unsigned int d_bin_size;
+  int d_bin_last;
+  unsigned long long d_prof;
+  unsigned long long d_interval;
+  struct timespec d_due;
+  unsigned long long d_dup_key;
+  unsigned long long d_dup_count;
+  unsigned long long d_dropped;
   int d_offset;
   int d_notify;
   unsigned char d_jump:1;
@@ -63,19 +232,92 @@ struct data_file{
   unsigned char d_moved:1;
 };
 
+struct out_mark{
+  struct data_file *m_df;
+  size_t m_out;
+  off_t m_pos;
+  off_t m_lines;
+  off_t m_had_pos;
+  off_t m_had_lines;
+};
+
+struct out_batch{
+  struct iovec *o_vector;
+  int o_count;
+  char *o_buffer;
+  unsigned int o_used;
+  struct out_mark *o_marks;
+  int o_mark;
+  size_t o_bytes;
+};
+
+#ifdef USE_URING
+struct ring_slot{
+  char *q_buffer;
+  struct iovec q_vector;
+  unsigned int q_index;
+  off_t q_offset;
+  int q_result;
+  int q_done;
+};
+
+struct uring{
+  int u_fd;
+  unsigned int *u_sq_head;
+  unsigned int *u_sq_tail;
+  unsigned int *u_sq_mask;
+  unsigned int *u_sq_array;
+  struct io_uring_sqe *u_sqes;
+  unsigned int *u_cq_head;
+  unsigned int *u_cq_tail;
+  unsigned int *u_cq_mask;
+  struct io_uring_cqe *u_cqes;
+  void *u_sq_map;
+  size_t u_sq_size;
+  void *u_cq_map;
+  size_t u_cq_size;
+  size_t u_sqe_size;
+  unsigned int u_pending;
+  struct ring_slot u_slots[RING_DEPTH];
+  unsigned int u_head;
+  unsigned int u_count;
+  char *u_carry;
+};
+#endif
+
+struct profile{
+  unsigned long long p_span[PROF_SPANS];
+  unsigned long long p_calls[PROF_CALLS];
+  unsigned long long p_in;
+  unsigned long long p_out;
+  unsigned long long p_partial;
+};
+
+/* a file named on the command line, opened at start-up */
+struct start_job{
+  char *j_name;
+  int j_relaxed;
+  int j_fd;
+  int j_failed;
+  int j_errno;
+  struct stat j_st;
+};
+
+#define JOB_OPEN    1
+#define JOB_STAT    2
+#define JOB_SPECIAL 3
+
 struct since_state{
-  int s_disk_device;
-  int s_disk_inode;
-  int s_disk_size;
+  int s_disk[FIELD_COUNT];
+  int s_disk_fields;
 
-  int s_arch_device;
-  int s_arch_inode;
-  int s_arch_size;
+  int s_arch[FIELD_COUNT];
 
   char s_fmt[MAX_FMT];
   int s_fmt_used;
   int s_fmt_output;
   int s_fmt_prefix;
+  int s_fmt_offset[FIELD_COUNT];
 
   int s_error;
   int s_readonly;
@@ -87,6 +329,75 @@ struct since_state{
   int s_atomic;
   int s_domap;
   int s_nozip;
+  int s_gc;
+  time_t s_gc_age;
+  time_t s_now;
+  int s_json;
+  int s_lines;
+  int s_sync;
+
+  char *s_record;
+  unsigned int s_record_len;
+
+  unsigned int *s_pick;
+  unsigned int s_pick_count;
+  unsigned int s_pick_max;
+  unsigned int *s_pick_at;
+  char s_delim;
+
+  int s_prefixes;
+  char *s_prefix;
+  unsigned int s_prefix_len;
+  struct timespec s_event;
+
+  int s_count;
+  regex_t s_match;
+  int s_have_match;
+  char *s_stamp;
+
+  int s_dedup;
+  int s_dedup_skip;
+  regex_t s_dedup_mask;
+  int s_have_mask;
+  unsigned int s_dedup_window;
+  struct dedup_cache s_cache;
+
+  unsigned int s_sample;
+  double s_rate;
+  double s_tokens;
+  struct timespec s_refill;
+
+  int s_engine;
+  int s_hints;
+  int s_to_pipe;
+  int s_gather;
+  int s_reverse;
+  char *s_read;
+  unsigned int s_read_size;
+  unsigned int s_read_max;
+
+  int s_uring;
+#ifdef USE_URING
+  struct uring s_ring;
+#endif
+
+  int s_profile;
+  char *s_prof_file;
+  struct profile s_prof;
+
+  int s_output;
+  struct data_file *s_current;
+
+  char *s_exec;
+  int s_coprocess;
+  pid_t s_exec_pid;
+  int s_ack;
+  size_t s_exec_size;
+  size_t s_exec_sent;
+  unsigned long long s_exec_total;
+  unsigned long long s_exec_acked;
+  char s_ack_line[MAX_FMT];
+  int s_ack_used;
 
   char *s_name;
   int s_fd;
@@ -102,10 +413,23 @@ struct since_state{
   struct data_file *s_data_files;
   unsigned int s_data_count;
 
+  struct start_job *s_jobs;
+  unsigned int s_job_count;
+  unsigned int s_job_size;
+  unsigned int s_job_next;
+
   sigset_t s_set;
   int s_notify;
 
   FILE *s_header;
+
+  struct out_batch s_batch;
+};
+
+struct long_map{
+  char *l_name;
+  int l_param;
+  int (*l_call)(struct since_state *sn, char *param);
 };
 
 struct fmt_map fmt_table[] = {
@@ -120,6 +444,16 @@ struct fmt_map fmt_table[] = {
 
 static void forget_state_file(struct since_state *sn);
 static int tmp_state_file(struct since_state *sn, int (*call)(struct since_state *sn));
+static int load_state_file(struct since_state *sn);
+static int update_state_file(struct since_state *sn);
+static unsigned int count_newlines(char *buffer, unsigned int len);
+static int flush_batch(struct since_state *sn);
+static int batch_text(struct since_state *sn, char *text, unsigned int len);
+static unsigned int json_escape(char *target, char *text, unsigned int len);
+#ifdef USE_URING
+static int ring_files(struct since_state *sn, int single);
+static void ring_destroy(struct since_state *sn);
+#endif
 
 volatile int since_run = 1;
 
@@ -198,6 +532,13 @@ static int tmp_state_file(struct since_state *sn, int (*call)(struct since_state
     unlink(tmp);
   }
 
+  if(sn->s_sync && fsync(nfd)){
+    fprintf(stderr, "since: unable to sync %s: %s\n", tmp, strerror(errno));
+    close(nfd);
+    unlink(tmp);
+    return -1;
+  }
+
   if(rename(tmp, sn->s_name)){
     fprintf(stderr, "since: unable to rename %s to %s: %s\n", tmp, sn->s_name, strerror(errno));
     close(nfd);
@@ -211,19 +552,115 @@ static int tmp_state_file(struct since_state *sn, int (*call)(struct since_state
   return 0;
 }
 
+/* profiling ************************************************/
+
+static char *prof_spans[PROF_SPANS] = { "open", "load", "check", "lookup", "display", "output", "update", "total" };
+static char *prof_calls[PROF_CALLS] = { "read", "pread", "write", "writev", "splice", "mmap", "lseek", "stat", "io_uring_enter" };
+
+/* adds the time since start to span, returns it in ns */
+static unsigned long long prof_span(struct since_state *sn, struct timespec *start, int span)
+{
+  struct timespec now;
+  unsigned long long delta;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  delta = ((now.tv_sec - start->tv_sec) * 1000000000ULL) + now.tv_nsec - start->tv_nsec;
+  sn->s_prof.p_span[span] += delta;
+
+  return delta;
+}
+
+static void prof_name(FILE *fp, char *name)
+{
+  char buffer[6 * 64];
+  unsigned int len, k;
+
+  fputc('"', fp);
+  for(len = strlen(name); len > 0; len -= k){
+    k = (len > 64) ? 64 : len;
+    while((k < len) && (k > 1) && ((name[k] & 0xc0) == 0x80)){
+      k--; /* keep multi-byte characters whole */
+    }
+    fwrite(buffer, 1, json_escape(buffer, name, k), fp);
+    name += k;
+  }
+  fputc('"', fp);
+}
+
+static int prof_report(struct since_state *sn)
+{
+  struct profile *pf;
+  unsigned int i;
+  FILE *fp;
+
+  pf = &(sn->s_prof);
+
+  if(sn->s_prof_file == NULL){
+    fprintf(stderr, "since: profile in seconds:");
+    for(i = 0; i < PROF_SPANS; i++){
+      fprintf(stderr, " %s=%.6f", prof_spans[i], pf->p_span[i] / 1000000000.0);
+    }
+    fprintf(stderr, "\nsince: profile calls:");
+    for(i = 0; i < PROF_CALLS; i++){
+      fprintf(stderr, " %s=%llu", prof_calls[i], pf->p_calls[i]);
+    }
+    fprintf(stderr, "\nsince: profile bytes: in=%llu out=%llu, partial writes=%llu\n", pf->p_in, pf->p_out, pf->p_partial);
+    /* with io_uring only the display of all files together is known */
+    for(i = 0; (sn->s_uring == 0) && (i < sn->s_data_count); i++){
+      fprintf(stderr, "since: profile display of %s took %.6fs\n", sn->s_data_files[i].d_name, sn->s_data_files[i].d_prof / 1000000000.0);
+    }
+    return 0;
+  }
+
+  fp = fopen(sn->s_prof_file, "w");
+  if(fp == NULL){
+    fprintf(stderr, "since: unable to create profile %s: %s\n", sn->s_prof_file, strerror(errno));
+    return -1;
+  }
+
+  fprintf(fp, "{\"seconds\":{");
+  for(i = 0; i < PROF_SPANS; i++){
+    fprintf(fp, "%s\"%s\":%.9f", i ? "," : "", prof_spans[i], pf->p_span[i] / 1000000000.0);
+  }
+  fprintf(fp, "},\"calls\":{");
+  for(i = 0; i < PROF_CALLS; i++){
+    fprintf(fp, "%s\"%s\":%llu", i ? "," : "", prof_calls[i], pf->p_calls[i]);
+  }
+  fprintf(fp, "},\"bytes_in\":%llu,\"bytes_out\":%llu,\"partial_writes\":%llu,\"files\":[", pf->p_in, pf->p_out, pf->p_partial);
+  for(i = 0; (sn->s_uring == 0) && (i < sn->s_data_count); i++){
+    fprintf(fp, "%s{\"name\":", i ? "," : "");
+    prof_name(fp, sn->s_data_files[i].d_name);
+    fprintf(fp, ",\"display\":%.9f}", sn->s_data_files[i].d_prof / 1000000000.0);
+  }
+  fprintf(fp, "]}\n");
+
+  if(fclose(fp)){
+    fprintf(stderr, "since: unable to write profile %s: %s\n", sn->s_prof_file, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
 /* sincefile stuff ******************************************/
 
 static void init_state(struct since_state *sn)
 {
   struct stat st;
-
-  sn->s_arch_device = sizeof(st.st_dev);
-  sn->s_arch_inode = sizeof(st.st_ino);
-  sn->s_arch_size = sizeof(st.st_size);
-
-  sn->s_disk_device = sn->s_arch_device;
-  sn->s_disk_inode = sn->s_arch_inode;
-  sn->s_disk_size = sn->s_arch_size;
+  int x;
+
+  sn->s_arch[FIELD_DEVICE] = sizeof(st.st_dev);
+  sn->s_arch[FIELD_INODE] = sizeof(st.st_ino);
+  sn->s_arch[FIELD_SIZE] = sizeof(st.st_size);
+  sn->s_arch[FIELD_SEEN] = sizeof(time_t);
+  sn->s_arch[FIELD_HEAD] = sizeof(unsigned long long);
+  sn->s_arch[FIELD_TAIL] = sizeof(unsigned long long);
+  sn->s_arch[FIELD_LINE] = sizeof(off_t);
+
+  for(x = 0; x < FIELD_COUNT; x++){
+    sn->s_disk[x] = sn->s_arch[x];
+  }
+  sn->s_disk_fields = FIELD_COUNT;
 
   sn->s_fmt_used = 0;
   sn->s_fmt_output = 0;
@@ -240,6 +677,73 @@ static void init_state(struct since_state *sn)
   sn->s_atomic = 0;
   sn->s_domap = 1;
   sn->s_nozip = 0;
+  sn->s_gc = 0;
+  sn->s_gc_age = 0;
+  sn->s_now = time(NULL);
+  sn->s_json = 0;
+  sn->s_lines = 0;
+  sn->s_sync = 0;
+
+  sn->s_prefixes = 0;
+  sn->s_prefix = NULL;
+  sn->s_prefix_len = 0;
+  sn->s_event.tv_sec = 0;
+  sn->s_event.tv_nsec = 0;
+
+  sn->s_count = 0;
+  sn->s_have_match = 0;
+  sn->s_stamp = NULL;
+
+  sn->s_dedup = 0;
+  sn->s_dedup_skip = 0;
+
+  sn->s_record = NULL;
+  sn->s_record_len = 0;
+
+  sn->s_pick = NULL;
+  sn->s_pick_count = 0;
+  sn->s_pick_max = 0;
+  sn->s_pick_at = NULL;
+  sn->s_delim = '\0';
+  sn->s_have_mask = 0;
+  sn->s_dedup_window = 0;
+  sn->s_cache.c_entries = NULL;
+  sn->s_cache.c_heads = NULL;
+
+  sn->s_sample = 0;
+  sn->s_rate = 0.0;
+  sn->s_tokens = 0.0;
+
+  sn->s_engine = ENGINE_AUTO;
+  sn->s_hints = 1;
+  sn->s_to_pipe = 0;
+  sn->s_gather = 0;
+  sn->s_reverse = 0;
+  sn->s_read = NULL;
+  sn->s_read_size = 0;
+  sn->s_read_max = READ_MAX;
+
+  sn->s_uring = 0;
+#ifdef USE_URING
+  sn->s_ring.u_fd = (-1);
+#endif
+
+  sn->s_profile = 0;
+  sn->s_prof_file = NULL;
+  memset(&(sn->s_prof), 0, sizeof(struct profile));
+
+  sn->s_output = STDOUT_FILENO;
+  sn->s_current = NULL;
+
+  sn->s_exec = NULL;
+  sn->s_coprocess = 0;
+  sn->s_exec_pid = (-1);
+  sn->s_ack = (-1);
+  sn->s_exec_size = EXEC_BATCH;
+  sn->s_exec_sent = 0;
+  sn->s_exec_total = 0;
+  sn->s_exec_acked = 0;
+  sn->s_ack_used = 0;
 
   sn->s_name = NULL;
   sn->s_fd = (-1);
@@ -254,9 +758,22 @@ static void init_state(struct since_state *sn)
   sn->s_data_files = NULL;
   sn->s_data_count = 0;
 
+  sn->s_jobs = NULL;
+  sn->s_job_count = 0;
+  sn->s_job_size = 0;
+  sn->s_job_next = 0;
+
   sn->s_notify = (-1);
 
   sn->s_header = stdout;
+
+  sn->s_batch.o_vector = NULL;
+  sn->s_batch.o_count = 0;
+  sn->s_batch.o_buffer = NULL;
+  sn->s_batch.o_used = 0;
+  sn->s_batch.o_marks = NULL;
+  sn->s_batch.o_mark = 0;
+  sn->s_batch.o_bytes = 0;
 }
 
 void destroy_state(struct since_state *sn)
@@ -274,12 +791,25 @@ void destroy_state(struct since_state *sn)
         df->d_fd = (-1);
       }
       df->d_offset = (-1);
+      if(df->d_json){
+        free(df->d_json);
+        df->d_json = NULL;
+      }
+      if(df->d_bins){
+        free(df->d_bins);
+        df->d_bins = NULL;
+      }
     }
     free(sn->s_data_files);
     sn->s_data_files = NULL;
   }
   sn->s_data_count = 0;
 
+  if(sn->s_jobs){
+    free(sn->s_jobs);
+    sn->s_jobs = NULL;
+  }
+
   if(sn->s_notify >= 0){
     close(sn->s_notify);
     sn->s_notify = (-1);
@@ -294,6 +824,61 @@ void destroy_state(struct since_state *sn)
     free(sn->s_name);
     sn->s_name = NULL;
   }
+
+  if(sn->s_batch.o_vector){
+    free(sn->s_batch.o_vector);
+    sn->s_batch.o_vector = NULL;
+  }
+  if(sn->s_batch.o_buffer){
+    free(sn->s_batch.o_buffer);
+    sn->s_batch.o_buffer = NULL;
+  }
+  if(sn->s_batch.o_marks){
+    free(sn->s_batch.o_marks);
+    sn->s_batch.o_marks = NULL;
+  }
+
+  if(sn->s_prefix){
+    free(sn->s_prefix);
+    sn->s_prefix = NULL;
+  }
+
+  if(sn->s_read){
+    free(sn->s_read);
+    sn->s_read = NULL;
+  }
+
+  if(sn->s_pick){
+    free(sn->s_pick);
+    sn->s_pick = NULL;
+  }
+  if(sn->s_pick_at){
+    free(sn->s_pick_at);
+    sn->s_pick_at = NULL;
+  }
+
+#ifdef USE_URING
+  ring_destroy(sn);
+#endif
+
+  if(sn->s_have_match){
+    regfree(&(sn->s_match));
+    sn->s_have_match = 0;
+  }
+
+  if(sn->s_have_mask){
+    regfree(&(sn->s_dedup_mask));
+    sn->s_have_mask = 0;
+  }
+
+  if(sn->s_cache.c_entries){
+    free(sn->s_cache.c_entries);
+    sn->s_cache.c_entries = NULL;
+  }
+  if(sn->s_cache.c_heads){
+    free(sn->s_cache.c_heads);
+    sn->s_cache.c_heads = NULL;
+  }
 }
 
 /* open state files *****************************************/
@@ -462,6 +1047,12 @@ static int load_state_file(struct since_state *sn)
     return -1;
   }
 
+  /* may be a reload after an update has moved the file offset */
+  if(lseek(sn->s_fd, 0, SEEK_SET) != 0){
+    fprintf(stderr, "since: unable to rewind %s: %s\n", sn->s_name, strerror(errno));
+    return -1;
+  }
+
   for(rt = 0; rt < sn->s_size;){
     rr = read(sn->s_fd, sn->s_buffer + rt, sn->s_size - rt);
     if(rr < 0){
@@ -492,11 +1083,7 @@ static int load_state_file(struct since_state *sn)
 
 static int check_state_file(struct since_state *sn)
 {
-  int i, x, w, d, sep[3];
-
-  sep[0] = ':';
-  sep[1] = ':';
-  sep[2] = '\n';
+  int i, x, w, d;
 
   if((sn->s_buffer == NULL) || (sn->s_size == 0)){
     if(sn->s_verbose > 2){
@@ -507,10 +1094,11 @@ static int check_state_file(struct since_state *sn)
 
   w = 0;
 
-  for(i = 0, x = 0; (i < sn->s_size) && (x < 3); i++){
+  for(i = 0, x = 0; (i < sn->s_size) && (x < FIELD_COUNT); i++){
     if(isxdigit(sn->s_buffer[i])){
       /* nothing */
-    } else if(sn->s_buffer[i] == sep[x]){
+    } else if(((sn->s_buffer[i] == ':') && (x + 1 < FIELD_COUNT)) ||
+              ((sn->s_buffer[i] == '\n') && (x + 1 >= FIELD_MIN))){
       d = (i - w);
       if(d % 2){
         fprintf(stderr, "since: data field has to contain an even number of bytes, not %d\n", d);
@@ -520,24 +1108,28 @@ static int check_state_file(struct since_state *sn)
 #ifdef DEBUG
       fprintf(stderr, "check: field[%d] is %d bytes\n", x, d);
 #endif
-      switch(x){
-        case 0 : sn->s_disk_device = d; break;
-        case 1 : sn->s_disk_inode = d; break;
-        case 2 : sn->s_disk_size = d; break;
-      }
+      sn->s_disk[x] = d;
       x++;
       w = i + 1;
+      if(sn->s_buffer[i] == '\n'){
+        break;
+      }
     } else {
       fprintf(stderr, "since: corrupt state file %s at %d\n", sn->s_name, i);
       return -1;
     }
   }
 
-  if(x < 3){
+  if(x < FIELD_MIN){
     fprintf(stderr, "since: no fields within %d bytes in file %s\n", i, sn->s_name);
     return -1;
   }
 
+  sn->s_disk_fields = x;
+  for(; x < FIELD_COUNT; x++){
+    sn->s_disk[x] = 0;
+  }
+
   return 0;
 }
 
@@ -546,33 +1138,29 @@ static int check_state_file(struct since_state *sn)
 static int internal_upgrade_state_file(struct since_state *sn)
 {
   char line[MAX_FMT], *ptr;
-  int result, sw, sr, i, k, x, pad[3], end[3], sep[3];
+  int result, sw, sr, i, k, x, pad[FIELD_COUNT], end[FIELD_COUNT], sep[FIELD_COUNT];
 
 #define bounded_delta(x, y)   (((x) < (y)) ? 0 : ((x) - (y)))
 
-  pad[0] = bounded_delta(sn->s_arch_device, sn->s_disk_device) * 2;
-  pad[1] = bounded_delta(sn->s_arch_inode, sn->s_disk_inode) * 2;
-  pad[2] = bounded_delta(sn->s_arch_size, sn->s_disk_size) * 2;
-
-  end[0] = sn->s_disk_device * 2;
-  end[1] = sn->s_disk_inode * 2;
-  end[2] = sn->s_disk_size * 2;
-
-  sep[0] = ':';
-  sep[1] = ':';
-  sep[2] = '\n';
-
-#undef bounded_delta
-
   sw = 0;
   sr = 0;
-  for(x = 0; x < 3; x++){
+  for(x = 0; x < FIELD_COUNT; x++){
+    /* missing fields are added as zeros, on disk size 0 */
+    pad[x] = bounded_delta(sn->s_arch[x], sn->s_disk[x]) * 2;
+    end[x] = sn->s_disk[x] * 2;
+    sep[x] = (x + 1 < sn->s_disk_fields) ? ':' : '\n';
+
     sw += pad[x] + end[x] + 1;
-    sr += end[x] + 1;
+    if(x < sn->s_disk_fields){
+      sr += end[x] + 1;
+    }
 #ifdef DEBUG
     fprintf(stderr, "since: padding[%d]: have=%d, expand=%d\n", x, end[x], pad[x]);
 #endif
   }
+
+#undef bounded_delta
+
 #ifdef DEBUG
   fprintf(stderr, "since: total: %d->%d\n", sr, sw);
 #endif
@@ -584,20 +1172,22 @@ static int internal_upgrade_state_file(struct since_state *sn)
   for(i = 0; i < sn->s_size; i+= sr){
     ptr = sn->s_buffer + i;
     k = 0;
-    for(x = 0; x < 3; x++){
+    for(x = 0; x < FIELD_COUNT; x++){
       if(pad[x] > 0){
         memset(line + k, '0', pad[x]);
         k += pad[x];
       }
-      memcpy(line + k, ptr, end[x]);
-      if(ptr[end[x]] != sep[x]){
-        fprintf(stderr, "since: data corruption: expected a separator, not 0x%x in line at %d in %s\n", ptr[end[x]], i, sn->s_name);
-        return -1;
+      if(x < sn->s_disk_fields){
+        memcpy(line + k, ptr, end[x]);
+        if(ptr[end[x]] != sep[x]){
+          fprintf(stderr, "since: data corruption: expected a separator, not 0x%x in line at %d in %s\n", ptr[end[x]], i, sn->s_name);
+          return -1;
+        }
+        k += end[x];
+        ptr += end[x] + 1;
       }
-      k += end[x];
-      line[k] = sep[x];
+      line[k] = (x + 1 < FIELD_COUNT) ? ':' : '\n';
       k++;
-      ptr += end[x] + 1;
     }
     result = write(sn->s_fd, line, k);
     if(result != sw){
@@ -606,9 +1196,10 @@ static int internal_upgrade_state_file(struct since_state *sn)
     }
   }
 
-  sn->s_disk_device += (pad[0] / 2);
-  sn->s_disk_inode += (pad[1] / 2);
-  sn->s_disk_size += (pad[2] / 2);
+  for(x = 0; x < FIELD_COUNT; x++){
+    sn->s_disk[x] += (pad[x] / 2);
+  }
+  sn->s_disk_fields = FIELD_COUNT;
 
   if(lseek(sn->s_fd, 0, SEEK_SET) != 0){
     fprintf(stderr, "since: unable to rewind tmp file to start: %s\n", strerror(errno));
@@ -620,13 +1211,24 @@ static int internal_upgrade_state_file(struct since_state *sn)
 
 static int maybe_upgrade_state_file(struct since_state *sn)
 {
-  if((sn->s_disk_device >= sn->s_arch_device) &&
-     (sn->s_disk_inode >= sn->s_arch_inode) &&
-     (sn->s_disk_size >= sn->s_arch_size)){
-    if(sn->s_verbose > 4){
-      fprintf(stderr, "since: state file data fields greater or equal to architecture, no rewrite needed\n");
+  int x;
+
+  for(x = 0; (x < sn->s_disk_fields) && (sn->s_disk[x] >= sn->s_arch[x]); x++);
+
+  if(x >= sn->s_disk_fields){
+    if(sn->s_disk_fields >= FIELD_COUNT){
+      if(sn->s_verbose > 4){
+        fprintf(stderr, "since: state file data fields greater or equal to architecture, no rewrite needed\n");
+      }
+      return 0;
+    }
+    if(sn->s_readonly){
+      /* missing fields can be done without if we do not write */
+      if(sn->s_verbose > 2){
+        fprintf(stderr, "since: state file %s lacks %d fields, not adding them as readonly\n", sn->s_name, FIELD_COUNT - sn->s_disk_fields);
+      }
+      return 0;
     }
-    return 0;
   }
 
   if(sn->s_readonly){
@@ -688,18 +1290,24 @@ static int make_fmt_field(struct since_state *sn, int disk, int arch, int suffix
 
 static int make_fmt_string(struct since_state *sn)
 {
-  int result;
+  int result, x, offset;
 
   sn->s_fmt_used = 0;
   sn->s_fmt_output = 0;
   sn->s_fmt_prefix = 0;
 
   result = 0;
+  offset = 0;
 
-  result += make_fmt_field(sn, sn->s_disk_device, sn->s_arch_device, ':');
-  result += make_fmt_field(sn, sn->s_disk_inode, sn->s_arch_inode, ':');
-  /* meh, we wanted to use \n, but snprintf runs over the edge */
-  result += make_fmt_field(sn, sn->s_disk_size, sn->s_arch_size, '\0');
+  for(x = 0; x < sn->s_disk_fields; x++){
+    sn->s_fmt_offset[x] = offset;
+    /* meh, we wanted to use \n, but snprintf runs over the edge */
+    result += make_fmt_field(sn, sn->s_disk[x], sn->s_arch[x], (x + 1 < sn->s_disk_fields) ? ':' : '\0');
+    offset += (2 * sn->s_disk[x]) + 1;
+  }
+  for(; x < FIELD_COUNT; x++){
+    sn->s_fmt_offset[x] = (-1);
+  }
 
   if(result){
     fprintf(stderr, "since: internal logic failure generating format string\n");
@@ -710,8 +1318,8 @@ static int make_fmt_string(struct since_state *sn)
   fprintf(stderr, "since: fmt string is %s", sn->s_fmt);
 #endif
 
-  sn->s_fmt_prefix = (2 * sn->s_disk_device) + 1 + (2 * sn->s_disk_inode);
-  sn->s_fmt_output = sn->s_fmt_prefix + 1 + (2 * sn->s_disk_size); /* WARNING: missing \n, added manually */
+  sn->s_fmt_prefix = sn->s_fmt_offset[FIELD_SIZE] - 1;
+  sn->s_fmt_output = offset - 1; /* WARNING: missing \n, added manually */
 
   if((sn->s_fmt_output + 1) >= MAX_FMT){
     fprintf(stderr, "since: oversize fields: limit=%d, wanted=%d\n", MAX_FMT, sn->s_fmt_output + 1);
@@ -725,12 +1333,15 @@ static int make_fmt_string(struct since_state *sn)
 
 static char *ignore_suffix[] = { ".gz", ".bz2", ".Z", ".zip", NULL };
 
-static int setup_data(struct since_state *sn, char *name)
+/* indexed by ENGINE_* */
+static char *engine_names[] = { "auto", "read", "mmap", "splice", "uring", NULL };
+
+/* remember a named file, opened later by open_data */
+static int queue_data(struct since_state *sn, char *name)
 {
-  struct data_file *tmp;
-  struct stat st;
-  int fd, i;
+  struct start_job *tmp;
   char *suffix;
+  int i;
 
   if(sn->s_nozip){
     suffix = strrchr(name, '.');
@@ -746,41 +1357,108 @@ static int setup_data(struct since_state *sn, char *name)
     }
   }
 
-  fd = open(name, O_RDONLY);
-  if(fd < 0){
-    fprintf(stderr, "since: unable to open %s: %s\n", name, strerror(errno));
-    return 1;
+  if(sn->s_job_count >= sn->s_job_size){
+    tmp = realloc(sn->s_jobs, sizeof(struct start_job) * ((sn->s_job_size * 2) + 16));
+    if(tmp == NULL){
+      fprintf(stderr, "since: unable to allocate space for %s\n", name);
+      return -1;
+    }
+    sn->s_jobs = tmp;
+    sn->s_job_size = (sn->s_job_size * 2) + 16;
   }
 
-  if(fstat(fd, &st)){
-    fprintf(stderr, "since: unable to fstat %s: %s\n", name, strerror(errno));
-    return 1;
+  tmp = &(sn->s_jobs[sn->s_job_count++]);
+  tmp->j_name = name;
+  tmp->j_relaxed = sn->s_relaxed; /* -l only applies to names after it */
+  tmp->j_fd = (-1);
+  tmp->j_failed = 0;
+  tmp->j_errno = 0;
+
+  return 0;
+}
+
+/* only system calls, messages are left to setup_data so that they appear in order */
+static void open_job(struct start_job *jb)
+{
+  jb->j_fd = open(jb->j_name, O_RDONLY);
+  if(jb->j_fd < 0){
+    jb->j_failed = JOB_OPEN;
+  } else if(fstat(jb->j_fd, &(jb->j_st))){
+    jb->j_failed = JOB_STAT;
+  } else if(!(S_IFREG & jb->j_st.st_mode)){
+    jb->j_failed = JOB_SPECIAL;
   }
+  jb->j_errno = errno;
+}
 
-  if(!(S_IFREG & st.st_mode)){
-    fprintf(stderr, "since: unable to handle special file %s\n", name);
-    return 1;
+static void *open_worker(void *arg)
+{
+  struct since_state *sn;
+  unsigned int k;
+
+  sn = arg;
+
+  while((k = __atomic_fetch_add(&(sn->s_job_next), 1, __ATOMIC_RELAXED)) < sn->s_job_count){
+    open_job(&(sn->s_jobs[k]));
   }
 
-  tmp = realloc(sn->s_data_files, sizeof(struct data_file) * (sn->s_data_count + 1));
-  if(tmp == NULL){
-    fprintf(stderr, "since: unable to allocate %u bytes for %s\n", sizeof(struct data_file) * (sn->s_data_count * 1), name);
-    return -1;
+  return NULL;
+}
+
+static int setup_data(struct since_state *sn, struct start_job *jb)
+{
+  struct data_file *tmp;
+
+  switch(jb->j_failed){
+    case JOB_OPEN :
+      fprintf(stderr, "since: unable to open %s: %s\n", jb->j_name, strerror(jb->j_errno));
+      return 1;
+    case JOB_STAT :
+      fprintf(stderr, "since: unable to fstat %s: %s\n", jb->j_name, strerror(jb->j_errno));
+      close(jb->j_fd);
+      return 1;
+    case JOB_SPECIAL :
+      fprintf(stderr, "since: unable to handle special file %s\n", jb->j_name);
+      close(jb->j_fd);
+      return 1;
   }
 
-  sn->s_data_files = tmp;
+  /* space for all of them was set aside by open_data */
   tmp = &(sn->s_data_files[sn->s_data_count]);
   sn->s_data_count++;
 
-  tmp->d_name = name;
-  tmp->d_fd = fd;
+  tmp->d_name = jb->j_name;
+  tmp->d_fd = jb->j_fd;
 
-  tmp->d_dev = st.st_dev;
-  tmp->d_ino = st.st_ino;
+  tmp->d_dev = jb->j_st.st_dev;
+  tmp->d_ino = jb->j_st.st_ino;
 
+  tmp->d_seen = 0;
+  tmp->d_head = 0;
+  tmp->d_tail = 0;
+  tmp->d_head_len = (-1);
   tmp->d_had = 0;
-  tmp->d_now = st.st_size;
+  tmp->d_now = jb->j_st.st_size;
   tmp->d_pos = 0;
+  tmp->d_lines = 0;
+  tmp->d_json = NULL;
+  tmp->d_json_len = 0;
+  tmp->d_event.tv_sec = 0;
+  tmp->d_event.tv_nsec = 0;
+  tmp->d_count_lines = 0;
+  tmp->d_count_bytes = 0;
+  tmp->d_count_matches = 0;
+  tmp->d_bins = NULL;
+  tmp->d_bin_count = 0;
+  tmp->d_bin_size = 0;
+  tmp->d_bin_last = (-1);
+  tmp->d_prof = 0;
+  tmp->d_interval = 0;
+  tmp->d_due.tv_sec = 0;
+  tmp->d_due.tv_nsec = 0;
+  tmp->d_dup_key = 0;
+  tmp->d_dup_count = 0;
+  tmp->d_dropped = 0;
 
   tmp->d_write = 0;
   tmp->d_jump = 0;
@@ -795,724 +1473,4679 @@ static int setup_data(struct since_state *sn, char *name)
   return 0;
 }
 
-/* lookup stuff *********************************************/
-
-static int lookup_entries(struct since_state *sn)
+/* open and fstat the queued files, in parallel as each may be a network round trip */
+static int open_data(struct since_state *sn)
 {
-  char line[MAX_FMT], *end;
-  int i, j, result;
-  struct data_file *df;
+  pthread_t threads[START_THREADS];
+  unsigned int i, n;
+  int result;
 
-  if((sn->s_buffer == NULL) || (sn->s_size == 0)){ /* file empty, nothing to look up */
-    return 0;
+  n = 0;
+  if(sn->s_job_count >= START_SERIAL){
+    for(n = 0; (n < START_THREADS) && (n < sn->s_job_count); n++){
+      if(pthread_create(&(threads[n]), NULL, &open_worker, sn)){
+        break; /* make do with fewer */
+      }
+    }
   }
 
-  /* could sort/index stuff to do better than O(n^2) */
-  for(i = 0; i < sn->s_data_count; i++){
-    df = &(sn->s_data_files[i]);
-    result = snprintf(line, MAX_FMT, sn->s_fmt, df->d_dev, df->d_ino, 0);
-    if(result != sn->s_fmt_output){
-      fprintf(stderr, "since: logic problem: expected state line to be %d bytes, printed %d\n", sn->s_fmt_output, result);
-      return -1;
-    }
-    for(j = 0; j < sn->s_size; j += (sn->s_fmt_output + 1)){
-      if(!memcmp(sn->s_buffer + j, line, sn->s_fmt_prefix)){
-        df->d_offset = j;
-        if(sn->s_arch_size > sizeof(unsigned long)){
-          df->d_had = strtoull(sn->s_buffer + j + sn->s_fmt_prefix + 1, &end, 16);
-        } else {
-          df->d_had = strtoul(sn->s_buffer + j + sn->s_fmt_prefix + 1, &end, 16);
-        }
-        if(end[0] != '\n'){
-          fprintf(stderr, "since: parse problem: unable to convert value at offset %d to number\n", j + sn->s_fmt_prefix + 1);
-          return -1;
-        }
+  open_worker(sn);
 
-        if(df->d_had > df->d_now){
-          fprintf(stderr, "since: considering %s to be truncated, displaying from start\n", df->d_name);
-          df->d_had = 0;
-          df->d_write = 1;
-        }
+  for(i = 0; i < n; i++){
+    pthread_join(threads[i], NULL);
+  }
 
-        if(df->d_pos != df->d_had){
-          /* pos is the value which gets saved */
-          df->d_pos = df->d_had;
-          df->d_jump = 1;
-        }
+  if(sn->s_job_count > 0){
+    sn->s_data_files = malloc(sizeof(struct data_file) * sn->s_job_count);
+    if(sn->s_data_files == NULL){
+      fprintf(stderr, "since: unable to allocate %lu bytes for files\n", (unsigned long)(sizeof(struct data_file) * sn->s_job_count));
+      return -1;
+    }
+  }
 
-        if(sn->s_verbose > 3){
-          /* this seems a bit risky, what if longs are bigger than wordsize ? */
-#if _FILE_OFFSET_BITS > __WORDSIZE
-          fprintf(stderr, "since: found record for %s at offset %d, now=%Lu, had=%Lu\n", df->d_name, j, df->d_now, df->d_had);
-#else
-          fprintf(stderr, "since: found record for %s at offset %d, now=%ld, had=%ld\n", df->d_name, j, df->d_now, df->d_had);
-#endif
-        }
-        break;
-      }
+  /* in argument order, as if opened one by one */
+  for(i = 0; i < sn->s_job_count; i++){
+    result = setup_data(sn, &(sn->s_jobs[i]));
+    if((result < 0) || ((sn->s_jobs[i].j_relaxed == 0) && (result > 0))){
+      return -1;
     }
   }
 
+  free(sn->s_jobs);
+  sn->s_jobs = NULL;
+  sn->s_job_count = 0;
+  sn->s_job_size = 0;
+
   return 0;
 }
 
-/* refresh using stat and sleep *****************************/
+/* record stuff *********************************************/
 
-static int setup_watch(struct since_state *sn)
+static int print_record(struct since_state *sn, char *target, dev_t dev, ino_t ino, off_t pos, unsigned long long head, unsigned long long tail, off_t lines)
 {
-#ifdef USE_INOTIFY
-  struct data_file *df;
-  unsigned int i;
+  int result;
 
-  sn->s_notify = inotify_init();
-  if(sn->s_notify < 0){
-    if(sn->s_verbose > 3){
-      fprintf(stderr, "since: unable to use inotify: %s\n", strerror(errno));
-    }
+  /* surplus arguments are ignored if the state file lacks the later fields */
+  result = snprintf(target, sn->s_fmt_output + 1, sn->s_fmt, dev, ino, pos, sn->s_now, head, tail, lines);
+  if(result != sn->s_fmt_output){
+    fprintf(stderr, "since: logic problem: expected state line to be %d bytes, printed %d\n", sn->s_fmt_output, result);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int parse_field(struct since_state *sn, char *record, int x, unsigned long long *value)
+{
+  char *end;
+
+  if(sn->s_fmt_offset[x] < 0){ /* field not in this state file */
+    *value = 0;
     return 1;
   }
 
-  for(i = 0; i < sn->s_data_count; i++){
-    df = &(sn->s_data_files[i]);
-    df->d_notify = inotify_add_watch(sn->s_notify, df->d_name, IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF);
-    if(df->d_notify < 0){
-      fprintf(stderr, "since: unable to register notification for %s: %s\n", df->d_name, strerror(errno));
-      close(sn->s_notify);
-      sn->s_notify = (-1);
-      return 1;
-    }
+  *value = strtoull(record + sn->s_fmt_offset[x], &end, 16);
+  if(end != record + sn->s_fmt_offset[x] + (2 * sn->s_disk[x])){
+    fprintf(stderr, "since: parse problem: unable to convert value at offset %d to number\n", (int)(record - sn->s_buffer) + sn->s_fmt_offset[x]);
+    return -1;
   }
-#endif
+
   return 0;
 }
 
-static int check_file(struct since_state *sn, struct data_file *df)
+/* fingerprint stuff ****************************************/
+
+static unsigned long long fingerprint(unsigned char *buffer, unsigned int len)
 {
-  struct stat st;
-  int again;
+  /* murmur64a, cheap and good enough to tell files apart */
+  const unsigned long long m = 0xc6a4a7935bd1e995ULL;
+  unsigned long long h, k;
+  unsigned int i;
 
-  if(stat(df->d_name, &st) == 0){
-    if((st.st_ino != df->d_ino) ||
-       (st.st_dev != df->d_dev)){
-      if(df->d_replaced == 0){
-        df->d_replaced = 1;
-        df->d_notable = 1;
-      }
-#ifdef DEBUG
-      fprintf(stderr, "check: file %s no longer matches\n", df->d_name);
-#endif
-      /* TODO: could re-open filename here, redo lookup, etc */
-      again = 1;
-    } else {
-      again = 0;
-      /* TODO: could note a rename back to the old name */
-      df->d_replaced = 0;
-      df->d_moved = 0;
-    }
-  } else {
-    switch(errno){
-      case ENOENT :
-        if(df->d_moved == 0){
-          df->d_moved = 1;
-          df->d_notable = 1;
-        }
-        break;
-        /* TODO: could quit on some critical errors sooner */
-    }
-    again = 1;
+  h = 0x51ace ^ (len * m);
+
+  for(i = 0; (i + sizeof(k)) <= len; i += sizeof(k)){
+    memcpy(&k, buffer + i, sizeof(k));
+    k *= m;
+    k ^= k >> 47;
+    k *= m;
+    h ^= k;
+    h *= m;
   }
 
-  if(again){
-    if(fstat(df->d_fd, &st)){
-      fprintf(stderr, "since: unable to stat %s: %s\n", df->d_name, strerror(errno));
-      return -1;
-    }
-    if(st.st_nlink == 0){
-      /* TODO: could delete entry to reduce inode collisions */
-      if(df->d_deleted == 0){
-        df->d_deleted = 1;
-        df->d_notable = 1;
-      }
-    } else {
-      if(df->d_moved == 0){
-        df->d_moved = 1;
-        df->d_notable = 1;
-      }
-    }
+  if(i < len){
+    k = 0;
+    memcpy(&k, buffer + i, len - i);
+    h ^= k;
+    h *= m;
   }
 
-#ifdef DEBUG
-  fprintf(stderr, "update: new size=%Lu, old max=%Lu\n", st.st_size, df->d_now);
-#endif
+  h ^= h >> 47;
+  h *= m;
+  h ^= h >> 47;
 
-  if(st.st_size < df->d_now){
-    fprintf(stderr, "since: considering %s to be truncated, displaying from start\n", df->d_name);
-    df->d_had = 0;
-    df->d_pos = 0;
-    df->d_jump = 1;
-    df->d_write = 1;
-    df->d_notable = 1;
-  }
+  return h ? h : 1; /* zero means no fingerprint */
+}
 
-  if(df->d_now < st.st_size){
-    df->d_notable = 1;
+static int read_range(struct data_file *df, unsigned char *buffer, unsigned int len, off_t offset)
+{
+  unsigned int rt;
+  int rr;
+
+  for(rt = 0; rt < len;){
+    rr = pread(df->d_fd, buffer + rt, len - rt, offset + rt);
+    if(rr < 0){
+      switch(errno){
+        case EAGAIN :
+        case EINTR :
+          continue;
+      }
+      return -1;
+    }
+    if(rr == 0){
+      return -1;
+    }
+    rt += rr;
   }
-  df->d_now = st.st_size;
 
   return 0;
 }
 
-static int notify_watch(struct since_state *sn)
+/* buffer may already hold the first have bytes of the file */
+static int same_content(struct since_state *sn, struct data_file *df, off_t pos, unsigned long long head, unsigned long long tail, unsigned char *buffer, unsigned int have)
 {
-#ifdef USE_INOTIFY
-  struct inotify_event update;
-  struct data_file *df;
-  char discard[PATH_MAX];
-  unsigned int i;
-  int result;
+  unsigned char end[PRINT_TAIL];
+  unsigned int len, tlen;
 
-#ifdef DEBUG
-  if(sn->s_notify < 0){
-    fprintf(stderr, "since: major logic error, no notify file descriptor\n");
-    abort();
+  if((pos <= 0) || (pos > df->d_now) || (head == 0)){
+    return 1; /* nothing we can compare */
   }
-#endif
 
-  sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
-  result = read(sn->s_notify, &update, sizeof(struct inotify_event));
-  sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
-
-  if(result < 0){
-    if(since_run == 0){
-      return 1;
-    }
-    if(sn->s_verbose > 1){
-      fprintf(stderr, "since: inotify failed: %s\n", strerror(errno));
+  len = (pos < PRINT_HEAD) ? pos : PRINT_HEAD;
+  if((have < len) && read_range(df, buffer, len, 0)){
+    if(sn->s_verbose > 2){
+      fprintf(stderr, "since: unable to read fingerprint of %s\n", df->d_name);
     }
-    return 0;
+    return 1;
   }
 
-  if(result != sizeof(struct inotify_event)){
-    fprintf(stderr, "since: inotify weirdness: read partial notification\n");
-    return -1;
+  if(fingerprint(buffer, len) != head){
+    return 0;
   }
 
-  if(sn->s_verbose > 4){
-    fprintf(stderr, "since: inotify mask 0x%x, len %u\n", update.mask, update.len);
+  df->d_head = head;
+  df->d_head_len = len;
+
+  if(tail == 0){
+    return 1;
   }
 
-  if(update.len > 0){
-    result = read(sn->s_notify, discard, update.len);
-    if(sn->s_verbose > 3){
-      fprintf(stderr, "since: discarding %u bytes of unexpected path information from inotify\n", update.len);
-    }
-    if(result != update.len){
-      fprintf(stderr, "since: inotify weirdness: unable to discard path information\n");
-      return -1;
+  tlen = (pos < PRINT_TAIL) ? pos : PRINT_TAIL;
+  if(pos > len){
+    /* usually the only second read, and only for large files, kept */
+    /* apart so that a caller can try its head on further records */
+    if(read_range(df, end, tlen, pos - tlen)){
+      return 1;
     }
+    return (fingerprint(end, tlen) == tail) ? 1 : 0;
   }
 
-  for(i = 0; i < sn->s_data_count; i++){
-    df = &(sn->s_data_files[i]);
-    if(update.wd == df->d_notify){
+  return (fingerprint(buffer + len - tlen, tlen) == tail) ? 1 : 0;
+}
 
-      if(check_file(sn, df) < 0){
-        return -1;
-      }
+static void update_fingerprint(struct since_state *sn, struct data_file *df)
+{
+  unsigned char buffer[PRINT_HEAD];
+  unsigned int len, tlen;
+
+  len = (df->d_pos < PRINT_HEAD) ? df->d_pos : PRINT_HEAD;
+  tlen = (df->d_pos < PRINT_TAIL) ? df->d_pos : PRINT_TAIL;
+
+  if(df->d_head_len != len){
+    if(read_range(df, buffer, len, 0)){
+      df->d_head = 0;
+      df->d_tail = 0;
+      df->d_head_len = (-1);
+      return;
+    }
+    df->d_head = fingerprint(buffer, len);
+    df->d_head_len = len;
+    if(df->d_pos <= len){
+      df->d_tail = fingerprint(buffer + len - tlen, tlen);
+      return;
     }
   }
 
-  return 0;
-#else
-#ifdef DEBUG
-  fprintf(stderr, "since: major logic error, doing disabled notification\n");
-  abort();
-#endif
-  return -1;
-#endif
+  if(read_range(df, buffer, tlen, df->d_pos - tlen)){
+    df->d_tail = 0;
+    return;
+  }
+  df->d_tail = fingerprint(buffer, tlen);
 }
 
-static int poll_watch(struct since_state *sn)
+/* look for a record of a file this one was copied from (copytruncate) */
+static int find_copy(struct since_state *sn, struct data_file *df)
 {
-  unsigned int i;
-  struct data_file *df;
+  unsigned char buffer[PRINT_HEAD];
+  char want[MAX_FMT];
+  unsigned long long head, size, tail, lines;
+  int j, width;
 
-  sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
-  nanosleep(&(sn->s_delay), NULL);
-  sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
+  if((df->d_now < PRINT_HEAD) || (sn->s_fmt_offset[FIELD_TAIL] < 0)){
+    return 0;
+  }
 
-  if(since_run == 0){
-    return 1;
+  if(read_range(df, buffer, PRINT_HEAD, 0)){
+    return 0;
   }
 
-  for(i = 0; i < sn->s_data_count; i++){
-    df = &(sn->s_data_files[i]);
-    if(check_file(sn, df) < 0){
+  head = fingerprint(buffer, PRINT_HEAD);
+
+  /* compare the text, cheaper than parsing every record */
+  width = 2 * sn->s_disk[FIELD_HEAD];
+  snprintf(want, MAX_FMT, "%0*llx", width, head);
+
+  for(j = 0; j < sn->s_size; j += (sn->s_fmt_output + 1)){
+    if(memcmp(sn->s_buffer + j + sn->s_fmt_offset[FIELD_HEAD], want, width)){
+      continue;
+    }
+    if((parse_field(sn, sn->s_buffer + j, FIELD_SIZE, &size) < 0) ||
+       (parse_field(sn, sn->s_buffer + j, FIELD_TAIL, &tail) < 0) ||
+       (parse_field(sn, sn->s_buffer + j, FIELD_LINE, &lines) < 0)){
       return -1;
     }
+    if((size < PRINT_HEAD) || (size > df->d_now)){
+      continue;
+    }
+    if(!same_content(sn, df, size, head, tail, buffer, PRINT_HEAD)){
+      continue;
+    }
+
+    if(sn->s_verbose > 1){
+      fprintf(stderr, "since: %s is a copy of a known file, displaying from %llu\n", df->d_name, size);
+    }
+
+    df->d_had = size;
+    df->d_pos = size;
+    df->d_lines = ((lines == 0) && (size > 0)) ? (-1) : lines;
+    df->d_jump = 1;
+    df->d_write = 1;
+
+    return 1;
   }
 
   return 0;
 }
 
-int run_watch(struct since_state *sn)
+/* lookup stuff *********************************************/
+
+/* returns offset of the record of df, -1 if there is none, less on error */
+static int find_record(struct since_state *sn, struct data_file *df)
 {
-  if(sn->s_notify < 0){
-    return poll_watch(sn);
-  } else {
-    return notify_watch(sn);
+  char line[MAX_FMT];
+  int j;
+
+  if(print_record(sn, line, df->d_dev, df->d_ino, 0, 0, 0, 0)){
+    return -2;
   }
-}
 
-/* display functions ****************************************/
+  for(j = 0; j < sn->s_size; j += (sn->s_fmt_output + 1)){
+    if(!memcmp(sn->s_buffer + j, line, sn->s_fmt_prefix)){
+      return j;
+    }
+  }
 
-static int display_header(struct since_state *sn, struct data_file *df, int single, int chuck)
+  return -1;
+}
+
+static int lookup_entries(struct since_state *sn)
 {
-  off_t delta;
-  unsigned int value, z;
-  int nada;
-  char *suffixes[] = { "b", "kb", "Mb", "Gb", "Tb", NULL} ;
+  unsigned char buffer[PRINT_HEAD];
+  unsigned long long value, head, tail, lines;
+  int i, j;
+  struct data_file *df;
 
-  switch(sn->s_verbose){
-    case 0 : return 0;
-    case 1 : if(single) return 0; /* WARNING: else fall */
-    case 2 : if(df->d_notable == 0) return 0;
+  if((sn->s_buffer == NULL) || (sn->s_size == 0)){ /* file empty, nothing to look up */
+    return 0;
   }
 
-  df->d_notable = 0;
-
-  /* possibly do unlocked io here */
-  fprintf(sn->s_header, "==> %s ", df->d_name);
+  /* could sort/index stuff to do better than O(n^2) */
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    j = find_record(sn, df);
+    if(j < (-1)){
+      return -1;
+    }
 
-  nada = 1;
+    if(j < 0){
+      if(find_copy(sn, df) < 0){
+        return -1;
+      }
+      continue;
+    }
 
-  if(df->d_deleted){
-    fprintf(sn->s_header, "[deleted] ");
-    nada = 0;
-  } else if(df->d_moved){
-    fprintf(sn->s_header, "[moved] ");
-    nada = 0;
-  }
+    df->d_offset = j;
+    if(parse_field(sn, sn->s_buffer + j, FIELD_SIZE, &value) < 0){
+      return -1;
+    }
+    df->d_had = value;
+    if(parse_field(sn, sn->s_buffer + j, FIELD_SEEN, &value) < 0){
+      return -1;
+    }
+    df->d_seen = value;
+    if((parse_field(sn, sn->s_buffer + j, FIELD_HEAD, &head) < 0) ||
+       (parse_field(sn, sn->s_buffer + j, FIELD_TAIL, &tail) < 0) ||
+       (parse_field(sn, sn->s_buffer + j, FIELD_LINE, &lines) < 0)){
+      return -1;
+    }
 
-#if 0
-  if(df->d_replaced){
-    /* we know about this, but won't say anything (yet) */
-    fprintf(sn->s_header, "[replaced]");
-  }
-#endif
+    if(df->d_had > df->d_now){
+      fprintf(stderr, "since: considering %s to be truncated, displaying from start\n", df->d_name);
+      df->d_had = 0;
+      df->d_write = 1;
+    } else if(!same_content(sn, df, df->d_had, head, tail, buffer, 0)){
+      /* copytruncate followed by growth, or a recycled inode */
+      fprintf(stderr, "since: content of %s has been replaced, displaying from start\n", df->d_name);
+      df->d_had = 0;
+      df->d_write = 1;
+    }
 
-  if(df->d_pos != df->d_now){
-    if(chuck){
-      fprintf(sn->s_header, "[discarded] ");
+    if(df->d_pos != df->d_had){
+      /* pos is the value which gets saved */
+      df->d_pos = df->d_had;
+      df->d_lines = ((lines == 0) && (df->d_had > 0)) ? (-1) : lines;
+      df->d_jump = 1;
     }
-    if(sn->s_verbose > 2){
-      delta = df->d_now - df->d_pos;
-      for(z = 0; (suffixes[z + 1]) && (delta > 9999); z++){
-        delta /= 1024;
-      }
-      value = delta;
-      fprintf(sn->s_header, "(+%u%s) ", value, suffixes[z]);
+
+    if(sn->s_verbose > 3){
+      /* this seems a bit risky, what if longs are bigger than wordsize ? */
+#if _FILE_OFFSET_BITS > __WORDSIZE
+      fprintf(stderr, "since: found record for %s at offset %d, now=%Lu, had=%Lu\n", df->d_name, j, df->d_now, df->d_had);
+#else
+      fprintf(stderr, "since: found record for %s at offset %d, now=%ld, had=%ld\n", df->d_name, j, df->d_now, df->d_had);
+#endif
     }
-    nada = 0;
   }
 
-  if(nada){
-    fprintf(sn->s_header, "[nothing new] ");
-  }
+  return 0;
+}
+
+/* after a commit the state file has been reloaded, records may have moved */
+static int relocate_entries(struct since_state *sn)
+{
+  unsigned int i;
+  int j;
 
-  fprintf(sn->s_header, "<==\n");
-  fflush(sn->s_header);
+  for(i = 0; i < sn->s_data_count; i++){
+    j = ((sn->s_buffer == NULL) || (sn->s_size == 0)) ? (-1) : find_record(sn, &(sn->s_data_files[i]));
+    if(j < (-1)){
+      return -1;
+    }
+    sn->s_data_files[i].d_offset = j;
+  }
 
   return 0;
 }
 
-static int display_buffer(struct since_state *sn, struct data_file *df, char *buffer, unsigned int len)
-{
-  int wr, result;
-  unsigned int wt, i, back;
+/* refresh using stat and sleep *****************************/
 
-#ifdef DEBUG
-  sleep(1);
+static int setup_notify(struct since_state *sn)
+{
+#ifdef USE_INOTIFY
+  struct data_file *df;
+  unsigned int i;
 
-  fprintf(stderr, "display: need to display %u bytes for %s\n", len, df->d_name);
-  if(len <= 0){
-    fprintf(stderr, "since: logic failure: writing out empty string\n");
+  sn->s_notify = inotify_init();
+  if(sn->s_notify < 0){
+    if(sn->s_verbose > 3){
+      fprintf(stderr, "since: unable to use inotify: %s\n", strerror(errno));
+    }
+    return 1;
   }
-#endif
-
-  wt = 0;
-  result = 1; /* used to infer signal */
-  since_run = 1;
-  sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
 
-  while(since_run){
-    wr = write(STDOUT_FILENO, buffer + wt, len - wt);
-    switch(wr){
-      case -1 :
-#ifdef DEBUG
-        fprintf(stderr, "display: write failed: %s\n", strerror(errno));
-#endif
-        switch(errno){
-          case EINTR :
-          case EPIPE :
-            since_run = 0;
-            result = 1;
-          case EAGAIN : /* iffy */
-            break;
-          default :
-            /* unlikely to do anything */
-            fprintf(stderr, "since: unable to display output: %s\n", strerror(errno));
-            since_run = 0;
-            result = (-1);
-        }
-        break;
-      case 0 :
-        /* WARNING: unsure how to deal with this one, should we exit */
-        break;
-      default :
-        wt += wr;
-        if(wt >= len){
-          since_run = 0;
-          result = 0;
-        }
-        break;
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    df->d_notify = inotify_add_watch(sn->s_notify, df->d_name, IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF);
+    if(df->d_notify < 0){
+      fprintf(stderr, "since: unable to register notification for %s: %s\n", df->d_name, strerror(errno));
+      close(sn->s_notify);
+      sn->s_notify = (-1);
+      return 1;
     }
   }
+#endif
+  return 0;
+}
 
-  sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
-  since_run = 1;
+static void add_time(struct timespec *ts, unsigned long long ns)
+{
+  ns += ts->tv_nsec;
+  ts->tv_sec += ns / 1000000000ULL;
+  ts->tv_nsec = ns % 1000000000ULL;
+}
 
-#ifdef DEBUG
-  fprintf(stderr, "display: final code is %d, wt %u\n", result, wt);
-#endif
+static int before(struct timespec *a, struct timespec *b)
+{
+  return (a->tv_sec < b->tv_sec) || ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
 
-  if(result < 0){ /* conventional error */
-    return (-1);
-  }
+/* every file starts out polled at the -d interval */
+static void setup_poll(struct since_state *sn)
+{
+  struct data_file *df;
+  struct timespec now;
+  unsigned int i;
 
-  if(result == 0){ /* success */
-    df->d_pos += len;
-    df->d_write = 1;
-    return 0;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    df->d_interval = (sn->s_delay.tv_sec * 1000000000ULL) + sn->s_delay.tv_nsec;
+    df->d_due = now;
+    add_time(&(df->d_due), df->d_interval);
   }
+}
 
-  /* user interrupt */
+static int setup_watch(struct since_state *sn)
+{
+  int result;
 
-  if(wt <= 0){
-    return 1;
+  result = setup_notify(sn);
+  if(result < 0){
+    return -1;
   }
 
-  /* no guarantees, just trying to restart on a new line */
-  back = (wt <= LINE_SEARCH) ? 0 : (wt - LINE_SEARCH);
-  i = wt;
+  if(sn->s_notify < 0){
+    setup_poll(sn);
+  }
 
-  do{
-    i--;
-    if(buffer[i] == '\n'){
-#ifdef DEBUG
-      fprintf(stderr, "recover: to newline at %u\n", i);
-#endif
-      wt = i + 1;
-      break;
-    }
-  } while(i > back);
+  return 0;
+}
 
+static void size_file(struct since_state *sn, struct data_file *df, struct stat *st)
+{
 #ifdef DEBUG
-  fprintf(stderr, "interrupt: at position %u\n", wt);
+  fprintf(stderr, "update: new size=%Lu, old max=%Lu\n", st->st_size, df->d_now);
 #endif
 
-  df->d_pos += wt;
-  df->d_write = 1;
+  if(st->st_size < df->d_now){
+    fprintf(stderr, "since: considering %s to be truncated, displaying from start\n", df->d_name);
+    df->d_had = 0;
+    df->d_pos = 0;
+    df->d_lines = 0;
+    df->d_jump = 1;
+    df->d_write = 1;
+    df->d_notable = 1;
+  }
 
-  return 1;
+  if(df->d_now < st->st_size){
+    df->d_notable = 1;
+    if(df->d_event.tv_sec == 0){
+      /* earliest unseen growth, for the delay prefix */
+      df->d_event = sn->s_event;
+    }
+  }
+  df->d_now = st->st_size;
 }
 
-static int display_file(struct since_state *sn, struct data_file *df, int single)
+static int check_file(struct since_state *sn, struct data_file *df)
 {
-  char *ptr;
-  char buffer[IO_BUFFER];
-  int rr, result;
-  off_t range, i;
-  unsigned int fixup;
+  struct stat st;
+  int again;
 
-  /* WARNING: should not manipulate d_had here, should be done in lookup and refresh, maybe pos resets too */
-  if(df->d_had > df->d_now){
-    fprintf(stderr, "since: considering %s to be truncated, displaying from start\n", df->d_name);
-    df->d_had = 0;
-    /* WARNING: d_pos gets saved, not d_had */
-    df->d_write = 1;
+  PROF_CALL(sn, PROF_STAT);
+  if(stat(df->d_name, &st) == 0){
+    if((st.st_ino != df->d_ino) ||
+       (st.st_dev != df->d_dev)){
+      if(df->d_replaced == 0){
+        df->d_replaced = 1;
+        df->d_notable = 1;
+      }
+#ifdef DEBUG
+      fprintf(stderr, "check: file %s no longer matches\n", df->d_name);
+#endif
+      /* TODO: could re-open filename here, redo lookup, etc */
+      again = 1;
+    } else {
+      again = 0;
+      /* TODO: could note a rename back to the old name */
+      df->d_replaced = 0;
+      df->d_moved = 0;
+    }
+  } else {
+    switch(errno){
+      case ENOENT :
+        if(df->d_moved == 0){
+          df->d_moved = 1;
+          df->d_notable = 1;
+        }
+        break;
+        /* TODO: could quit on some critical errors sooner */
+    }
+    again = 1;
   }
 
-  if(df->d_pos < df->d_had){
-    df->d_jump = 1;
-    df->d_pos = df->d_had;
+  if(again){
+    PROF_CALL(sn, PROF_STAT);
+    if(fstat(df->d_fd, &st)){
+      fprintf(stderr, "since: unable to stat %s: %s\n", df->d_name, strerror(errno));
+      return -1;
+    }
+    if(st.st_nlink == 0){
+      /* with gc enabled its record gets dropped at update time */
+      if(df->d_deleted == 0){
+        df->d_deleted = 1;
+        df->d_notable = 1;
+      }
+    } else {
+      if(df->d_moved == 0){
+        df->d_moved = 1;
+        df->d_notable = 1;
+      }
+    }
   }
 
+  size_file(sn, df, &st);
+
+  return 0;
+}
+
+static int notify_watch(struct since_state *sn)
+{
+#ifdef USE_INOTIFY
+  struct inotify_event update;
+  struct data_file *df;
+  char discard[PATH_MAX];
+  unsigned int i;
+  int result;
+
 #ifdef DEBUG
-  if(df->d_pos > df->d_now){
-    fprintf(stderr, "since: logic failure - position pointer has overtaken length\n");
+  if(sn->s_notify < 0){
+    fprintf(stderr, "since: major logic error, no notify file descriptor\n");
     abort();
   }
 #endif
 
-  range = df->d_now - df->d_pos;
-  if(range == 0){
-    display_header(sn, df, single, 0);
+  sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
+  result = read(sn->s_notify, &update, sizeof(struct inotify_event));
+  sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
+
+  if(result < 0){
+    if(since_run == 0){
+      return 1;
+    }
+    if(sn->s_verbose > 1){
+      fprintf(stderr, "since: inotify failed: %s\n", strerror(errno));
+    }
     return 0;
   }
 
-  if((range > IO_BUFFER) && sn->s_domap){
-    fixup = df->d_pos & (IO_BUFFER - 1);
-    ptr = mmap(NULL, range + range, PROT_READ, MAP_PRIVATE, df->d_fd, df->d_pos - fixup);
-    if((void *)(ptr) != MAP_FAILED){
-      display_header(sn, df, single, 0);
+  if(result != sizeof(struct inotify_event)){
+    fprintf(stderr, "since: inotify weirdness: read partial notification\n");
+    return -1;
+  }
 
-      result = display_buffer(sn, df, ptr + fixup, range);
-      df->d_jump = 1;
-      munmap(ptr, range + fixup);
+  clock_gettime(CLOCK_MONOTONIC, &(sn->s_event));
 
-      return result;
-#ifdef DEBUG
-    } else {
-      fprintf(stderr, "display: mmap of %d failed: %s\n", df->d_fd, strerror(errno));
-#endif
-    }
+  if(sn->s_verbose > 4){
+    fprintf(stderr, "since: inotify mask 0x%x, len %u\n", update.mask, update.len);
   }
 
-  if(df->d_jump){
-    if(lseek(df->d_fd, df->d_pos, SEEK_SET) != df->d_pos){
-      fprintf(stderr, "since: unable to seek in file %s: %s\n", df->d_name, strerror(errno));
+  if(update.len > 0){
+    result = read(sn->s_notify, discard, update.len);
+    if(sn->s_verbose > 3){
+      fprintf(stderr, "since: discarding %u bytes of unexpected path information from inotify\n", update.len);
+    }
+    if(result != update.len){
+      fprintf(stderr, "since: inotify weirdness: unable to discard path information\n");
       return -1;
     }
-    df->d_jump = 0;
   }
 
-  display_header(sn, df, single, 0);
-  i = 0;
-  df->d_write = 1;
-  while(df->d_pos < df->d_now){
-    rr = read(df->d_fd, buffer, IO_BUFFER);
-    switch(rr){
-      case -1 :
-        switch(errno){
-          case EAGAIN :
-          case EINTR  :
-            break;
-          default :
-            fprintf(stderr, "since: unable to read from %s: %s\n", df->d_name, strerror(errno));
-            return -1;
-        }
-        break;
-      case  0 :
-        fprintf(stderr, "since: unexpected eof while reading from %s\n", df->d_name);
-        break;
-      default :
-        result = display_buffer(sn, df, buffer, rr);
-        if(result != 0){
-          return result;
-        }
-        break;
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    if(update.wd == df->d_notify){
+
+      if(check_file(sn, df) < 0){
+        return -1;
+      }
     }
   }
 
-  if(df->d_now < df->d_pos){
-    /* in case more gets append to file while reading */
-    df->d_now = df->d_pos;
-  }
+  return 0;
+#else
+#ifdef DEBUG
+  fprintf(stderr, "since: major logic error, doing disabled notification\n");
+  abort();
+#endif
+  return -1;
+#endif
+}
+
+/* a growing file only gets an fstat of its descriptor, the path is looked at once it goes quiet */
+static int poll_file(struct since_state *sn, struct data_file *df)
+{
+  struct stat st;
+  unsigned long long delay;
+  off_t had;
+
+  had = df->d_now;
+
+  PROF_CALL(sn, PROF_STAT);
+  if(fstat(df->d_fd, &st)){
+    fprintf(stderr, "since: unable to stat %s: %s\n", df->d_name, strerror(errno));
+    return -1;
+  }
+
+  if(st.st_size != df->d_now){
+    size_file(sn, df, &st);
+  } else if(check_file(sn, df) < 0){
+    return -1;
+  }
+
+  delay = (sn->s_delay.tv_sec * 1000000000ULL) + sn->s_delay.tv_nsec;
+  if(df->d_now != had){
+    df->d_interval = delay / POLL_FAST;
+  } else if(df->d_interval < (delay * POLL_SLOW)){
+    df->d_interval = ((df->d_interval * 2) > (delay * POLL_SLOW)) ? (delay * POLL_SLOW) : (df->d_interval * 2);
+    if(df->d_interval == 0){
+      df->d_interval = 1; /* -d 0, keep polling as fast as possible */
+    }
+  }
+
+  if(sn->s_verbose > 4){
+    fprintf(stderr, "since: polling %s every %.3fs\n", df->d_name, df->d_interval / 1000000000.0);
+  }
+
+  df->d_due = sn->s_event;
+  add_time(&(df->d_due), df->d_interval);
+
+  return 0;
+}
+
+static int poll_watch(struct since_state *sn)
+{
+  unsigned int i;
+  struct data_file *df;
+  struct timespec due;
+
+  due = sn->s_data_files[0].d_due;
+  for(i = 1; i < sn->s_data_count; i++){
+    if(before(&(sn->s_data_files[i].d_due), &due)){
+      due = sn->s_data_files[i].d_due;
+    }
+  }
+
+  sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+  sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
+
+  if(since_run == 0){
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &(sn->s_event));
+
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    if(before(&(sn->s_event), &(df->d_due))){
+      continue;
+    }
+    if(poll_file(sn, df) < 0){
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int run_watch(struct since_state *sn)
+{
+  if(sn->s_notify < 0){
+    return poll_watch(sn);
+  } else {
+    return notify_watch(sn);
+  }
+}
+
+/* display functions ****************************************/
+
+/* a header shares the output batch when it goes to the same place */
+static void header_text(struct since_state *sn, char *text, unsigned int len)
+{
+  if(sn->s_gather && (sn->s_header == stdout)){
+    batch_text(sn, text, len);
+  } else {
+    fwrite(text, 1, len, sn->s_header);
+  }
+}
+
+static int display_header(struct since_state *sn, struct data_file *df, int single, int chuck)
+{
+  char tmp[MAX_FMT];
+  off_t delta;
+  unsigned int value, z;
+  int nada, len;
+  char *suffixes[] = { "b", "kb", "Mb", "Gb", "Tb", NULL} ;
+
+  if((sn->s_json || sn->s_count) && (sn->s_header == stdout)){
+    return 0; /* would corrupt the stream */
+  }
+
+  switch(sn->s_verbose){
+    case 0 : return 0;
+    case 1 : if(single) return 0; /* WARNING: else fall */
+    case 2 : if(df->d_notable == 0) return 0;
+  }
+
+  df->d_notable = 0;
+
+  if((sn->s_gather == 0) || (sn->s_header != stdout)){
+    /* keep the order of data and headers on a terminal */
+    flush_batch(sn);
+  }
+
+  header_text(sn, "==> ", 4);
+  header_text(sn, df->d_name, strlen(df->d_name));
+  header_text(sn, " ", 1);
+
+  nada = 1;
+
+  if(df->d_deleted){
+    header_text(sn, "[deleted] ", 10);
+    nada = 0;
+  } else if(df->d_moved){
+    header_text(sn, "[moved] ", 8);
+    nada = 0;
+  }
+
+#if 0
+  if(df->d_replaced){
+    /* we know about this, but won't say anything (yet) */
+    fprintf(sn->s_header, "[replaced]");
+  }
+#endif
+
+  if(df->d_pos != df->d_now){
+    if(chuck){
+      header_text(sn, "[discarded] ", 12);
+    }
+    if(sn->s_verbose > 2){
+      delta = df->d_now - df->d_pos;
+      for(z = 0; (suffixes[z + 1]) && (delta > 9999); z++){
+        delta /= 1024;
+      }
+      value = delta;
+      len = snprintf(tmp, MAX_FMT, "(+%u%s) ", value, suffixes[z]);
+      header_text(sn, tmp, len);
+    }
+    nada = 0;
+  }
+
+  if(nada){
+    header_text(sn, "[nothing new] ", 14);
+  }
+
+  header_text(sn, "<==\n", 4);
+  if((sn->s_gather == 0) || (sn->s_header != stdout)){
+    fflush(sn->s_header);
+  }
+
+  return 0;
+}
+
+/* downstream command *************************************/
+
+static int commit_state_file(struct since_state *sn)
+{
+  int result;
+
+  result = update_state_file(sn);
+  if(result < 0){
+    return -1;
+  }
+  if(result > 0){ /* readonly, nothing was written or forgotten */
+    return 0;
+  }
+
+  if(load_state_file(sn) < 0){
+    return -1;
+  }
+
+  return relocate_entries(sn);
+}
+
+static int start_exec(struct since_state *sn, struct data_file *df)
+{
+  char tmp[MAX_FMT];
+  int feed[2], ack[2];
+  pid_t pid;
+
+  if(pipe(feed)){
+    fprintf(stderr, "since: unable to create pipe: %s\n", strerror(errno));
+    return -1;
+  }
+
+  ack[0] = ack[1] = (-1);
+  if(sn->s_coprocess && pipe(ack)){
+    fprintf(stderr, "since: unable to create pipe: %s\n", strerror(errno));
+    close(feed[0]);
+    close(feed[1]);
+    return -1;
+  }
+
+  if(sn->s_verbose > 2){
+    fprintf(stderr, "since: starting %s\n", sn->s_exec);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(stderr, "since: unable to fork: %s\n", strerror(errno));
+    close(feed[0]);
+    close(feed[1]);
+    if(ack[0] >= 0){
+      close(ack[0]);
+      close(ack[1]);
+    }
+    return -1;
+  }
+
+  if(pid == 0){
+    dup2(feed[0], STDIN_FILENO);
+    close(feed[0]);
+    close(feed[1]);
+    if(ack[1] >= 0){
+      dup2(ack[1], STDOUT_FILENO);
+      close(ack[0]);
+      close(ack[1]);
+    }
+
+    if(sn->s_coprocess == 0){
+      /* lets the command recognise a batch it has seen before */
+      setenv("SINCE_FILE", df->d_name, 1);
+      snprintf(tmp, MAX_FMT, "%llu", (unsigned long long)(df->d_ino));
+      setenv("SINCE_INODE", tmp, 1);
+      snprintf(tmp, MAX_FMT, "%llu", (unsigned long long)(df->d_pos));
+      setenv("SINCE_OFFSET", tmp, 1);
+    }
+
+    sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
+    execl("/bin/sh", "sh", "-c", sn->s_exec, (char *)NULL);
+
+    fprintf(stderr, "since: unable to run %s: %s\n", sn->s_exec, strerror(errno));
+    _exit(EX_OSERR);
+  }
+
+  close(feed[0]);
+  fcntl(feed[1], F_SETFD, FD_CLOEXEC);
+  sn->s_output = feed[1];
+
+  if(ack[0] >= 0){
+    close(ack[1]);
+    fcntl(ack[0], F_SETFD, FD_CLOEXEC);
+    fcntl(ack[0], F_SETFL, O_NONBLOCK);
+    /* so that we can collect acks instead of deadlocking on a full pipe */
+    fcntl(feed[1], F_SETFL, O_NONBLOCK);
+    sn->s_ack = ack[0];
+  }
+
+  sn->s_exec_pid = pid;
+  sn->s_exec_sent = 0;
+
+  return 0;
+}
+
+/* acks are lines holding the number of bytes the coprocess has dealt with */
+static int read_acks(struct since_state *sn)
+{
+  char *ptr, *nl;
+  unsigned long long value;
+  int rr;
+
+  rr = read(sn->s_ack, sn->s_ack_line + sn->s_ack_used, MAX_FMT - sn->s_ack_used);
+  if(rr < 0){
+    switch(errno){
+      case EAGAIN :
+      case EINTR :
+        return 0;
+    }
+    fprintf(stderr, "since: unable to read acknowledgement from %s: %s\n", sn->s_exec, strerror(errno));
+    return -1;
+  }
+  if(rr == 0){
+    fprintf(stderr, "since: %s went away without acknowledging\n", sn->s_exec);
+    return -1;
+  }
+
+  sn->s_ack_used += rr;
+
+  ptr = sn->s_ack_line;
+  while((nl = memchr(ptr, '\n', sn->s_ack_used - (ptr - sn->s_ack_line))) != NULL){
+    value = strtoull(ptr, NULL, 10);
+    if(value > sn->s_exec_acked){
+      sn->s_exec_acked = value;
+    }
+    ptr = nl + 1;
+  }
+
+  sn->s_ack_used -= (ptr - sn->s_ack_line);
+  memmove(sn->s_ack_line, ptr, sn->s_ack_used);
+
+  if(sn->s_ack_used >= MAX_FMT){
+    fprintf(stderr, "since: overlong acknowledgement from %s\n", sn->s_exec);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* called when the output would block */
+static int wait_output(struct since_state *sn)
+{
+  struct pollfd pfd[2];
+  int count;
+
+  pfd[0].fd = sn->s_output;
+  pfd[0].events = POLLOUT;
+  count = 1;
+
+  if(sn->s_ack >= 0){
+    pfd[1].fd = sn->s_ack;
+    pfd[1].events = POLLIN;
+    count = 2;
+  }
+
+  if(poll(pfd, count, -1) < 0){
+    return 0; /* interrupted, the caller checks */
+  }
+
+  if((count > 1) && (pfd[1].revents)){
+    return read_acks(sn);
+  }
+
+  return 0;
+}
+
+static int end_batch(struct since_state *sn)
+{
+  int status;
+
+  if(sn->s_exec_pid < 0){
+    return 0;
+  }
+
+  if(sn->s_coprocess){
+    while(sn->s_exec_acked < sn->s_exec_total){
+      if(read_acks(sn)){
+        return -1;
+      }
+      if(sn->s_exec_acked < sn->s_exec_total){
+        struct pollfd pfd;
+        pfd.fd = sn->s_ack;
+        pfd.events = POLLIN;
+        poll(&pfd, 1, -1);
+      }
+    }
+  } else {
+    close(sn->s_output);
+    sn->s_output = (-1);
+
+    while(waitpid(sn->s_exec_pid, &status, 0) < 0){
+      if(errno != EINTR){
+        fprintf(stderr, "since: unable to wait for %s: %s\n", sn->s_exec, strerror(errno));
+        return -1;
+      }
+    }
+    sn->s_exec_pid = (-1);
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status)){
+      fprintf(stderr, "since: %s failed, not recording the last %lu bytes as seen\n", sn->s_exec, (unsigned long)(sn->s_exec_sent));
+      return -1;
+    }
+  }
+
+  if(sn->s_verbose > 2){
+    fprintf(stderr, "since: %s accepted %lu bytes\n", sn->s_exec, (unsigned long)(sn->s_exec_sent));
+  }
+
+  sn->s_exec_sent = 0;
+
+  return commit_state_file(sn);
+}
+
+static int finish_exec(struct since_state *sn)
+{
+  int status, result;
+
+  if(sn->s_exec == NULL){
+    return 0;
+  }
+
+  result = 0;
+  if(sn->s_exec_sent > 0){
+    result = end_batch(sn);
+  }
+
+  if(sn->s_exec_pid >= 0){
+    if(sn->s_output >= 0){
+      close(sn->s_output);
+      sn->s_output = (-1);
+    }
+    if(sn->s_ack >= 0){
+      close(sn->s_ack);
+      sn->s_ack = (-1);
+    }
+    while((waitpid(sn->s_exec_pid, &status, 0) < 0) && (errno == EINTR));
+    sn->s_exec_pid = (-1);
+  }
+
+  return result;
+}
+
+static int exec_check(struct since_state *sn)
+{
+  if((sn->s_exec == NULL) || (sn->s_exec_sent < sn->s_exec_size)){
+    return 0;
+  }
+
+  return end_batch(sn);
+}
+
+/* aggregation ***********************************************/
+
+static int count_buffer(struct since_state *sn, struct data_file *df, char *buffer, unsigned int len)
+{
+  unsigned int lines;
+
+  lines = count_newlines(buffer, len);
+
+  df->d_count_lines += lines;
+  df->d_count_bytes += len;
+
+  df->d_pos += len;
+  if(df->d_lines >= 0){
+    df->d_lines += lines;
+  }
+  df->d_write = 1;
+
+  return 0;
+}
+
+static struct count_bin *find_bin(struct data_file *df, time_t minute)
+{
+  struct count_bin *tmp;
+  int i;
+
+  /* logs are mostly in order, so usually the last bin is the one */
+  if((df->d_bin_last >= 0) && (df->d_bins[df->d_bin_last].b_minute == minute)){
+    return &(df->d_bins[df->d_bin_last]);
+  }
+
+  for(i = df->d_bin_count - 1; (i >= 0) && (df->d_bins[i].b_minute > minute); i--);
+  if((i >= 0) && (df->d_bins[i].b_minute == minute)){
+    df->d_bin_last = i;
+    return &(df->d_bins[i]);
+  }
+
+  if(df->d_bin_count >= df->d_bin_size){
+    tmp = realloc(df->d_bins, sizeof(struct count_bin) * (df->d_bin_size + 64));
+    if(tmp == NULL){
+      fprintf(stderr, "since: unable to allocate histogram for %s\n", df->d_name);
+      return NULL;
+    }
+    df->d_bins = tmp;
+    df->d_bin_size += 64;
+  }
+
+  /* keep sorted, insert after i */
+  i++;
+  memmove(&(df->d_bins[i + 1]), &(df->d_bins[i]), sizeof(struct count_bin) * (df->d_bin_count - i));
+  df->d_bin_count++;
+
+  df->d_bins[i].b_minute = minute;
+  df->d_bins[i].b_lines = 0;
+  df->d_bins[i].b_matches = 0;
+  df->d_bin_last = i;
+
+  return &(df->d_bins[i]);
+}
+
+/* returns nonzero if the line matches */
+static int match_line(struct since_state *sn, char *line, unsigned int len)
+{
+#ifdef REG_STARTEND
+  regmatch_t range;
+
+  range.rm_so = 0;
+  range.rm_eo = len;
+
+  return regexec(&(sn->s_match), line, 0, &range, REG_STARTEND) ? 0 : 1;
+#else
+  char *tmp;
+  int result;
+
+  tmp = malloc(len + 1);
+  if(tmp == NULL){
+    return 0;
+  }
+  memcpy(tmp, line, len);
+  tmp[len] = '\0';
+  result = regexec(&(sn->s_match), tmp, 0, NULL, 0) ? 0 : 1;
+  free(tmp);
+
+  return result;
+#endif
+}
+
+static int stamp_line(struct since_state *sn, char *line, unsigned int len, time_t *minute)
+{
+  char tmp[MAX_FMT];
+  struct tm tm, now;
+  time_t t;
+
+  if(len >= MAX_FMT){
+    len = MAX_FMT - 1;
+  }
+  memcpy(tmp, line, len);
+  tmp[len] = '\0';
+
+  memset(&tm, 0, sizeof(struct tm));
+  tm.tm_mday = 1;
+  if(strptime(tmp, sn->s_stamp, &tm) == NULL){
+    return 1;
+  }
+
+  if(tm.tm_year == 0){
+    /* format without a year, as in syslog */
+    t = time(NULL);
+    localtime_r(&t, &now);
+    tm.tm_year = now.tm_year;
+  }
+
+  tm.tm_sec = 0;
+  *minute = timegm(&tm);
+
+  return 0;
+}
+
+/* len includes the newline */
+static int count_line(struct since_state *sn, struct data_file *df, char *line, unsigned int len)
+{
+  struct count_bin *cb;
+  time_t minute;
+  int hit;
+
+  df->d_count_bytes += len;
+  if(line[len - 1] == '\n'){
+    df->d_count_lines++;
+    len--;
+  }
+
+  hit = 0;
+  if(sn->s_have_match){
+    hit = match_line(sn, line, len);
+    df->d_count_matches += hit;
+  }
+
+  if(sn->s_count & COUNT_MINUTE){
+    if(stamp_line(sn, line, len, &minute) == 0){
+      cb = find_bin(df, minute);
+      if(cb == NULL){
+        return -1;
+      }
+    } else {
+      /* continuation lines without a stamp belong to the previous one */
+      cb = (df->d_bin_last >= 0) ? &(df->d_bins[df->d_bin_last]) : NULL;
+    }
+    if(cb){
+      cb->b_lines++;
+      cb->b_matches += hit;
+    }
+  }
+
+  return 0;
+}
+
+static void report_counts(struct since_state *sn)
+{
+  struct data_file *df;
+  struct tm tm;
+  char when[MAX_FMT];
+  unsigned int i, j;
+
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+
+    if(sn->s_count & COUNT_TOTAL){
+      printf("%s\t%llu\t%llu", df->d_name, df->d_count_lines, df->d_count_bytes);
+      if(sn->s_have_match){
+        printf("\t%llu", df->d_count_matches);
+      }
+      printf("\n");
+    }
+
+    for(j = 0; j < df->d_bin_count; j++){
+      gmtime_r(&(df->d_bins[j].b_minute), &tm);
+      strftime(when, MAX_FMT, "%Y-%m-%dT%H:%M", &tm);
+      printf("%s\t%s\t%llu", df->d_name, when, df->d_bins[j].b_lines);
+      if(sn->s_have_match){
+        printf("\t%llu", df->d_bins[j].b_matches);
+      }
+      printf("\n");
+    }
+
+    df->d_count_lines = 0;
+    df->d_count_bytes = 0;
+    df->d_count_matches = 0;
+    df->d_bin_count = 0;
+    df->d_bin_last = (-1);
+  }
+
+  fflush(stdout);
+}
+
+/* line oriented output ************************************/
+
+static unsigned int count_newlines(char *buffer, unsigned int len)
+{
+  char *ptr, *end;
+  unsigned int count;
+#ifdef __SSE2__
+  __m128i nl, acc, sum, zero;
+  int k;
+#endif
+
+  count = 0;
+  ptr = buffer;
+  end = buffer + len;
+
+#ifdef __SSE2__
+  /* compares yield -1 per match, bytewise counters are folded before they can wrap */
+  nl = _mm_set1_epi8('\n');
+  zero = _mm_setzero_si128();
+  sum = zero;
+  while((end - ptr) >= 16){
+    acc = zero;
+    for(k = 0; (k < 255) && ((end - ptr) >= 16); k++){
+      acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)ptr), nl));
+      ptr += 16;
+    }
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(acc, zero));
+  }
+  count = _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(sum, sum));
+#endif
+
+  for(; (ptr < end) && ((ptr = memchr(ptr, '\n', end - ptr)) != NULL); ptr++){
+    count++;
+  }
+
+  return count;
+}
+
+static int count_lines(struct since_state *sn, struct data_file *df)
+{
+  char buffer[IO_BUFFER * 16];
+  off_t at;
+  unsigned int len;
+  int rr;
+
+  if(sn->s_verbose > 2){
+    fprintf(stderr, "since: counting lines of %s\n", df->d_name);
+  }
+
+  df->d_lines = 0;
+  for(at = 0; at < df->d_pos; at += rr){
+    len = ((df->d_pos - at) < sizeof(buffer)) ? (df->d_pos - at) : sizeof(buffer);
+    rr = pread(df->d_fd, buffer, len, at);
+    PROF_CALL(sn, PROF_PREAD);
+    if(rr < 0){
+      switch(errno){
+        case EAGAIN :
+        case EINTR :
+          rr = 0;
+          continue;
+      }
+      fprintf(stderr, "since: unable to read from %s: %s\n", df->d_name, strerror(errno));
+      return -1;
+    }
+    if(rr == 0){
+      fprintf(stderr, "since: unexpected eof while counting lines of %s\n", df->d_name);
+      return -1;
+    }
+    df->d_lines += count_newlines(buffer, rr);
+  }
+
+  return 0;
+}
+
+static int setup_batch(struct since_state *sn)
+{
+  struct out_batch *ob;
+  unsigned int i, longest;
+
+  ob = &(sn->s_batch);
+
+  ob->o_vector = malloc(sizeof(struct iovec) * OUTPUT_VECTOR);
+  ob->o_buffer = malloc(OUTPUT_BUFFER);
+  ob->o_marks = malloc(sizeof(struct out_mark) * OUTPUT_MARKS);
+
+  if((ob->o_vector == NULL) || (ob->o_buffer == NULL) || (ob->o_marks == NULL)){
+    fprintf(stderr, "since: unable to allocate output buffers\n");
+    return -1;
+  }
+
+  if(sn->s_prefixes){
+    longest = 0;
+    for(i = 0; i < sn->s_data_count; i++){
+      if(strlen(sn->s_data_files[i].d_name) > longest){
+        longest = strlen(sn->s_data_files[i].d_name);
+      }
+    }
+    sn->s_prefix = malloc(MAX_FMT + longest);
+    if(sn->s_prefix == NULL){
+      fprintf(stderr, "since: unable to allocate prefix buffer\n");
+      return -1;
+    }
+  }
+
+  ob->o_count = 0;
+  ob->o_used = 0;
+  ob->o_mark = 0;
+  ob->o_bytes = 0;
+
+  return 0;
+}
+
+static int flush_batch(struct since_state *sn)
+{
+  struct out_batch *ob;
+  struct out_mark *om;
+  struct iovec *iov;
+  struct timespec t;
+  int count, i, result;
+  ssize_t wr, want;
+  size_t done;
+
+  ob = &(sn->s_batch);
+
+  done = 0;
+  result = 0;
+
+  if((ob->o_count > 0) && (sn->s_output < 0)){
+    if(start_exec(sn, sn->s_current)){
+      result = (-1);
+      ob->o_count = 0; /* discard, nothing gets marked */
+    }
+  }
+
+  if(ob->o_count > 0){
+    iov = ob->o_vector;
+    count = ob->o_count;
+    result = 1; /* used to infer signal */
+    since_run = 1;
+    sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
+
+    while(since_run){
+      PROF_BEGIN(sn, t);
+      wr = writev(sn->s_output, iov, (count > OUTPUT_VECTOR) ? OUTPUT_VECTOR : count);
+      if(sn->s_profile){
+        prof_span(sn, &t, PROF_OUTPUT);
+        sn->s_prof.p_calls[PROF_WRITEV]++;
+        if(wr > 0){
+          sn->s_prof.p_out += wr;
+          for(want = 0, i = 0; (i < count) && (i < OUTPUT_VECTOR); i++){
+            want += iov[i].iov_len;
+          }
+          if(wr < want){
+            sn->s_prof.p_partial++;
+          }
+        }
+      }
+      if(wr < 0){
+        switch(errno){
+          case EINTR :
+          case EPIPE :
+            since_run = 0;
+            result = 1;
+            break;
+          case EAGAIN :
+            if(wait_output(sn)){
+              since_run = 0;
+              result = (-1);
+            }
+            break;
+          default :
+            fprintf(stderr, "since: unable to display output: %s\n", strerror(errno));
+            since_run = 0;
+            result = (-1);
+        }
+        continue;
+      }
+      done += wr;
+      sn->s_exec_sent += wr;
+      sn->s_exec_total += wr;
+      while((count > 0) && (wr >= iov->iov_len)){
+        wr -= iov->iov_len;
+        iov++;
+        count--;
+      }
+      if(count <= 0){
+        since_run = 0;
+        result = 0;
+      } else {
+        iov->iov_base = (char *)(iov->iov_base) + wr;
+        iov->iov_len -= wr;
+      }
+    }
+
+    sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
+    since_run = 1;
+  }
+
+  /* wind files back to before the first of their marks which has not made it out */
+  for(i = ob->o_mark; i > 0; i--){
+    om = &(ob->o_marks[i - 1]);
+    if(om->m_out <= done){
+      break;
+    }
+    om->m_df->d_pos = om->m_had_pos;
+    om->m_df->d_lines = om->m_had_lines;
+  }
+
+  ob->o_count = 0;
+  ob->o_used = 0;
+  ob->o_mark = 0;
+  ob->o_bytes = 0;
+
+  return result;
+}
+
+static int batch_text(struct since_state *sn, char *text, unsigned int len)
+{
+  struct out_batch *ob;
+  struct iovec *iov;
+  int result;
+
+  ob = &(sn->s_batch);
+
+  if(((ob->o_used + len) > OUTPUT_BUFFER) || (ob->o_count >= OUTPUT_VECTOR)){
+    result = flush_batch(sn);
+    if(result){
+      return result;
+    }
+    if(len > OUTPUT_BUFFER){
+      fprintf(stderr, "since: logic problem: staging %u bytes exceeds limit\n", len);
+      return -1;
+    }
+  }
+
+  iov = (ob->o_count > 0) ? &(ob->o_vector[ob->o_count - 1]) : NULL;
+  if(iov && ((char *)(iov->iov_base) + iov->iov_len == ob->o_buffer + ob->o_used)){
+    iov->iov_len += len;
+  } else {
+    iov = &(ob->o_vector[ob->o_count++]);
+    iov->iov_base = ob->o_buffer + ob->o_used;
+    iov->iov_len = len;
+  }
+
+  memcpy(ob->o_buffer + ob->o_used, text, len);
+  ob->o_used += len;
+  ob->o_bytes += len;
+
+  return 0;
+}
+
+/* claim len bytes already placed at the end of the staging area, caller ensures space */
+static int batch_commit(struct since_state *sn, unsigned int len)
+{
+  struct out_batch *ob;
+  struct iovec *iov;
+
+  ob = &(sn->s_batch);
+
+  iov = (ob->o_count > 0) ? &(ob->o_vector[ob->o_count - 1]) : NULL;
+  if(iov && ((char *)(iov->iov_base) + iov->iov_len == ob->o_buffer + ob->o_used)){
+    iov->iov_len += len;
+  } else {
+    if(ob->o_count >= OUTPUT_VECTOR){
+      fprintf(stderr, "since: logic problem: no vector space to commit %u bytes\n", len);
+      return -1;
+    }
+    iov = &(ob->o_vector[ob->o_count++]);
+    iov->iov_base = ob->o_buffer + ob->o_used;
+    iov->iov_len = len;
+  }
+
+  ob->o_used += len;
+  ob->o_bytes += len;
+
+  return 0;
+}
+
+/* the slice has to stay valid until the batch is flushed */
+static int batch_slice(struct since_state *sn, char *text, unsigned int len)
+{
+  struct out_batch *ob;
+  struct iovec *iov;
+  int result;
+
+  ob = &(sn->s_batch);
+
+  if(ob->o_count >= OUTPUT_VECTOR){
+    result = flush_batch(sn);
+    if(result){
+      return result;
+    }
+  }
+
+  iov = &(ob->o_vector[ob->o_count++]);
+  iov->iov_base = text;
+  iov->iov_len = len;
+  ob->o_bytes += len;
+
+  return 0;
+}
+
+static int batch_mark(struct since_state *sn, struct data_file *df, off_t pos, off_t lines)
+{
+  struct out_batch *ob;
+  struct out_mark *om;
+  int result;
+
+  ob = &(sn->s_batch);
+
+  if(ob->o_mark >= OUTPUT_MARKS){
+    /* lots of short lines, make room */
+    result = flush_batch(sn);
+    if(result){
+      return result;
+    }
+  }
+
+  om = &(ob->o_marks[ob->o_mark++]);
+  om->m_df = df;
+  om->m_out = ob->o_bytes;
+  om->m_pos = pos;
+  om->m_lines = lines;
+  om->m_had_pos = df->d_pos;
+  om->m_had_lines = df->d_lines;
+
+  /* counts as seen right away, flush_batch winds back what does not make it out */
+  df->d_pos = pos;
+  df->d_lines = lines;
+  df->d_write = 1;
+
+  return 0;
+}
+
+/* lets queued output outlive the buffers its slices refer to, by copying or writing them */
+static int keep_batch(struct since_state *sn)
+{
+  struct out_batch *ob;
+  struct iovec *iov;
+  unsigned int i, need;
+
+  ob = &(sn->s_batch);
+
+  if(sn->s_gather == 0){
+    return flush_batch(sn);
+  }
+
+  need = 0;
+  for(i = 0; i < ob->o_count; i++){
+    iov = &(ob->o_vector[i]);
+    if(((char *)(iov->iov_base) < ob->o_buffer) || ((char *)(iov->iov_base) >= (ob->o_buffer + OUTPUT_BUFFER))){
+      need += iov->iov_len;
+    }
+  }
+
+  if(need == 0){
+    return 0;
+  }
+
+  if((ob->o_used + need) > OUTPUT_BUFFER){
+    return flush_batch(sn);
+  }
+
+  for(i = 0; i < ob->o_count; i++){
+    iov = &(ob->o_vector[i]);
+    if(((char *)(iov->iov_base) < ob->o_buffer) || ((char *)(iov->iov_base) >= (ob->o_buffer + OUTPUT_BUFFER))){
+      memcpy(ob->o_buffer + ob->o_used, iov->iov_base, iov->iov_len);
+      iov->iov_base = ob->o_buffer + ob->o_used;
+      ob->o_used += iov->iov_len;
+    }
+  }
+
+  return 0;
+}
+
+/* length of the well formed UTF-8 sequence at text, 0 if there is none */
+static unsigned int utf8_length(unsigned char *text, unsigned int len)
+{
+  unsigned char lo, hi;
+  unsigned int i, n;
+
+  lo = 0x80;
+  hi = 0xbf;
+
+  if((text[0] >= 0xc2) && (text[0] <= 0xdf)){
+    n = 2;
+  } else if((text[0] >= 0xe0) && (text[0] <= 0xef)){
+    n = 3;
+    if(text[0] == 0xe0){
+      lo = 0xa0; /* overlong */
+    } else if(text[0] == 0xed){
+      hi = 0x9f; /* surrogates */
+    }
+  } else if((text[0] >= 0xf0) && (text[0] <= 0xf4)){
+    n = 4;
+    if(text[0] == 0xf0){
+      lo = 0x90; /* overlong */
+    } else if(text[0] == 0xf4){
+      hi = 0x8f; /* beyond U+10FFFF */
+    }
+  } else {
+    return 0;
+  }
+
+  if((n > len) || (text[1] < lo) || (text[1] > hi)){
+    return 0;
+  }
+  for(i = 2; i < n; i++){
+    if((text[i] & 0xc0) != 0x80){
+      return 0;
+    }
+  }
+
+  return n;
+}
+
+/* returns the length of the prefix which needs no escaping, ascii and */
+/* well formed UTF-8, copied to target unless that is NULL */
+static unsigned int json_plain(char *target, char *text, unsigned int len)
+{
+  unsigned int i, n;
+  unsigned char u;
+#ifdef __SSE2__
+  __m128i v, low, quote, slash;
+  unsigned int at, bits;
+
+  low = _mm_set1_epi8(0x1f);
+  quote = _mm_set1_epi8('"');
+  slash = _mm_set1_epi8('\\');
+
+  i = 0;
+  while((len >= 16) && (i < len)){
+    /* the last block overlaps the one before, no byte by byte tail */
+    at = ((i + 16) <= len) ? i : (len - 16);
+    v = _mm_loadu_si128((__m128i *)(text + at));
+    if(target){
+      /* store before looking, bytes past a stop are simply not counted */
+      _mm_storeu_si128((__m128i *)(target + at), v);
+    }
+    /* unsigned v <= 0x1f is max(v, 0x1f) == 0x1f, the high bits come free */
+    bits = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+             _mm_cmpeq_epi8(_mm_max_epu8(v, low), low),
+             _mm_cmpeq_epi8(v, quote)),
+             _mm_cmpeq_epi8(v, slash))) | _mm_movemask_epi8(v);
+    bits >>= (i - at);
+    if(bits == 0){
+      i = at + 16;
+      continue;
+    }
+    i += __builtin_ctz(bits);
+    if((unsigned char)(text[i]) < 0x80){
+      return i;
+    }
+    n = utf8_length((unsigned char *)text + i, len - i);
+    if(n == 0){
+      return i;
+    }
+    if(target){
+      memcpy(target + i, text + i, n);
+    }
+    i += n;
+  }
+#else
+  i = 0;
+#endif
+
+  for(; i < len; i += n){
+    u = text[i];
+    if(u < 0x80){
+      if((u < 0x20) || (u == '"') || (u == '\\')){
+        break;
+      }
+      n = 1;
+    } else {
+      n = utf8_length((unsigned char *)text + i, len - i);
+      if(n == 0){
+        break;
+      }
+    }
+    if(target){
+      memcpy(target + i, text + i, n);
+    }
+  }
+
+  return i;
+}
+
+static unsigned int json_char(char *target, unsigned char u)
+{
+  static char hex[] = "0123456789abcdef";
+
+  target[0] = '\\';
+
+  switch(u){
+    case '"'  : target[1] = '"';  return 2;
+    case '\\' : target[1] = '\\'; return 2;
+    case '\n' : target[1] = 'n';  return 2;
+    case '\r' : target[1] = 'r';  return 2;
+    case '\t' : target[1] = 't';  return 2;
+    case '\b' : target[1] = 'b';  return 2;
+    case '\f' : target[1] = 'f';  return 2;
+  }
+
+  target[1] = 'u';
+  target[2] = '0';
+  target[3] = '0';
+  target[4] = hex[u >> 4];
+  target[5] = hex[u & 0xf];
+
+  return 6;
+}
+
+/* escapes text to target, which needs room for 6 bytes per byte of text */
+static unsigned int json_escape(char *target, char *text, unsigned int len)
+{
+  unsigned int i, k, n;
+
+  i = 0;
+  k = 0;
+  while(i < len){
+    n = json_plain(target + k, text + i, len - i);
+    i += n;
+    k += n;
+    if(i < len){
+      k += json_char(target + k, text[i]);
+      i++;
+    }
+  }
+
+  return k;
+}
+
+static int json_string(struct since_state *sn, char *text, unsigned int len)
+{
+  char escape[6];
+  unsigned int k;
+  int result;
+
+  while(len > 0){
+    k = json_plain(NULL, text, len);
+    if(k > 0){
+      result = (k >= OUTPUT_SLICE) ? batch_slice(sn, text, k) : batch_text(sn, text, k);
+      if(result){
+        return result;
+      }
+      text += k;
+      len -= k;
+      if(len == 0){
+        break;
+      }
+    }
+
+    result = batch_text(sn, escape, json_char(escape, text[0]));
+    if(result){
+      return result;
+    }
+    text++;
+    len--;
+  }
+
+  return 0;
+}
+
+static unsigned int print_decimal(char *target, unsigned long long value)
+{
+  static const char pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+  unsigned long long t;
+  unsigned int len, r, v;
+  char *ptr;
+
+  /* hot in the json path: count first, then two digits per division, in 32 bits where possible */
+  len = 1;
+  for(t = value; t >= 10000; t /= 10000){
+    len += 4;
+  }
+  for(; t >= 10; t /= 10){
+    len++;
+  }
+
+  ptr = target + len;
+  while(value > 0xffffffffULL){
+    r = value % 100;
+    value /= 100;
+    ptr -= 2;
+    memcpy(ptr, pairs + (2 * r), 2);
+  }
+  v = value;
+  while(v >= 100){
+    r = v % 100;
+    v /= 100;
+    ptr -= 2;
+    memcpy(ptr, pairs + (2 * r), 2);
+  }
+  if(v >= 10){
+    memcpy(ptr - 2, pairs + (2 * v), 2);
+  } else {
+    ptr[-1] = '0' + v;
+  }
+
+  return len;
+}
+
+/* the part of an object which stays the same for every line of a file */
+static int make_json_prefix(struct data_file *df)
+{
+  unsigned int k, len;
+
+  len = strlen(df->d_name);
+
+  df->d_json = malloc((len * 6) + MAX_FMT);
+  if(df->d_json == NULL){
+    fprintf(stderr, "since: unable to allocate json prefix for %s\n", df->d_name);
+    return -1;
+  }
+
+  k = 0;
+  memcpy(df->d_json + k, "{\"file\":\"", 9);
+  k += 9;
+  k += json_escape(df->d_json + k, df->d_name, len);
+  memcpy(df->d_json + k, "\",\"inode\":", 10);
+  k += 10;
+  k += print_decimal(df->d_json + k, df->d_ino);
+  memcpy(df->d_json + k, ",\"offset\":", 10);
+  k += 10;
+
+  df->d_json_len = k;
+
+  return 0;
+}
+
+/* the start of an object, up to the opening quote of its text */
+static unsigned int json_head(struct data_file *df, char *target, off_t pos, off_t number)
+{
+  unsigned int k;
+
+  k = df->d_json_len;
+  memcpy(target, df->d_json, k);
+  k += print_decimal(target + k, pos);
+  memcpy(target + k, ",\"line\":", 8);
+  k += 8;
+  k += print_decimal(target + k, number);
+  memcpy(target + k, ",\"text\":\"", 9);
+  k += 9;
+
+  return k;
+}
+
+/* the common case, a line short enough to stage whole: its end is found */
+/* while escaping it, so the data is read once; take stays 0 if it is not */
+static int json_line(struct since_state *sn, struct data_file *df, char *line, unsigned int len, off_t pos, off_t number, unsigned int *take)
+{
+  struct out_batch *ob;
+  char *ptr;
+  unsigned int i, k, n;
+  int result;
+
+  *take = 0;
+
+  if((df->d_json == NULL) && make_json_prefix(df)){
+    return -1;
+  }
+
+  if(len > OUTPUT_SLICE){
+    len = OUTPUT_SLICE; /* longer lines go the general way */
+  }
+
+  ob = &(sn->s_batch);
+  if(((ob->o_used + df->d_json_len + MAX_FMT + (6 * len)) > OUTPUT_BUFFER) || (ob->o_count >= OUTPUT_VECTOR)){
+    result = flush_batch(sn);
+    if(result){
+      return result;
+    }
+  }
+
+  ptr = ob->o_buffer + ob->o_used;
+  k = json_head(df, ptr, pos, number);
+
+  i = 0;
+  while(1){
+    n = json_plain(ptr + k, line + i, len - i);
+    i += n;
+    k += n;
+    if(i >= len){
+      return 0; /* no end in sight, nothing committed */
+    }
+    if(line[i] == '\n'){
+      break;
+    }
+    k += json_char(ptr + k, line[i]);
+    i++;
+  }
+
+  memcpy(ptr + k, "\"}\n", 3);
+  k += 3;
+  *take = i + 1;
+
+  return batch_commit(sn, k);
+}
+
+static int emit_json(struct since_state *sn, struct data_file *df, char *line, unsigned int len, off_t pos, off_t number)
+{
+  struct out_batch *ob;
+  char *ptr;
+  unsigned int k, need, plain;
+  int result;
+
+  if((df->d_json == NULL) && make_json_prefix(df)){
+    return -1;
+  }
+
+  ob = &(sn->s_batch);
+
+  /* common case: small clean line, assembled in place */
+  need = df->d_json_len + MAX_FMT + len;
+  if(need > OUTPUT_BUFFER){
+    need = df->d_json_len + MAX_FMT;
+  }
+  if(((ob->o_used + need) > OUTPUT_BUFFER) || (ob->o_count >= OUTPUT_VECTOR)){
+    result = flush_batch(sn);
+    if(result){
+      return result;
+    }
+  }
+
+  ptr = ob->o_buffer + ob->o_used;
+  k = json_head(df, ptr, pos, number);
+
+  /* one pass checks and copies, whatever is plain stays in place */
+  plain = 0;
+  if((len < OUTPUT_SLICE) && ((ob->o_used + k + len + 3) <= OUTPUT_BUFFER)){
+    plain = json_plain(ptr + k, line, len);
+    k += plain;
+    if(plain == len){
+      memcpy(ptr + k, "\"}\n", 3);
+      k += 3;
+      return batch_commit(sn, k);
+    }
+  }
+
+  result = batch_commit(sn, k);
+  if(result == 0){
+    result = json_string(sn, line + plain, len - plain);
+  }
+  if(result == 0){
+    result = batch_text(sn, "\"}\n", 3);
+  }
+
+  return result;
+}
+
+/* sampling *************************************************/
+
+/* returns 1 if the line is to be kept, len includes the newline */
+static int sample_line(struct since_state *sn, char *line, unsigned int len)
+{
+  struct timespec now;
+  double elapsed;
+
+  if(sn->s_sample > 1){
+    /* by content, so that reruns pick the same lines */
+    if(fingerprint((unsigned char *)line, (line[len - 1] == '\n') ? (len - 1) : len) % sn->s_sample){
+      return 0;
+    }
+  }
+
+  if(sn->s_rate > 0.0){
+    /* token bucket, allows a burst of one second worth of lines, */
+    /* but at least one line, or rates below 1/s would never print */
+    if(sn->s_tokens < 1.0){
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      elapsed = (now.tv_sec - sn->s_refill.tv_sec) + ((now.tv_nsec - sn->s_refill.tv_nsec) / 1000000000.0);
+      sn->s_refill = now;
+      sn->s_tokens += elapsed * sn->s_rate;
+      if(sn->s_tokens > ((sn->s_rate > 1.0) ? sn->s_rate : 1.0)){
+        sn->s_tokens = (sn->s_rate > 1.0) ? sn->s_rate : 1.0;
+      }
+      if(sn->s_tokens < 1.0){
+        return 0;
+      }
+    }
+    sn->s_tokens -= 1.0;
+  }
+
+  return 1;
+}
+
+/* duplicate lines ******************************************/
+
+static int setup_dedup(struct since_state *sn)
+{
+  struct dedup_cache *dc;
+  unsigned int i;
+
+  dc = &(sn->s_cache);
+
+  for(i = 1; i < (sn->s_dedup_window * 2); i *= 2);
+
+  dc->c_entries = malloc(sizeof(struct dedup_entry) * sn->s_dedup_window);
+  dc->c_heads = malloc(sizeof(int) * i);
+  if((dc->c_entries == NULL) || (dc->c_heads == NULL)){
+    fprintf(stderr, "since: unable to allocate a window of %u lines\n", sn->s_dedup_window);
+    return -1;
+  }
+
+  dc->c_mask = i - 1;
+  dc->c_size = sn->s_dedup_window;
+  dc->c_used = 0;
+  dc->c_first = (-1);
+  dc->c_last = (-1);
+
+  for(i = 0; i <= dc->c_mask; i++){
+    dc->c_heads[i] = (-1);
+  }
+
+  return 0;
+}
+
+static void lru_unlink(struct dedup_cache *dc, int i)
+{
+  struct dedup_entry *de;
+
+  de = &(dc->c_entries[i]);
+
+  if(de->e_prev >= 0){
+    dc->c_entries[de->e_prev].e_next = de->e_next;
+  } else {
+    dc->c_first = de->e_next;
+  }
+  if(de->e_next >= 0){
+    dc->c_entries[de->e_next].e_prev = de->e_prev;
+  } else {
+    dc->c_last = de->e_prev;
+  }
+}
+
+static void lru_front(struct dedup_cache *dc, int i)
+{
+  struct dedup_entry *de;
+
+  de = &(dc->c_entries[i]);
+
+  de->e_prev = (-1);
+  de->e_next = dc->c_first;
+  if(dc->c_first >= 0){
+    dc->c_entries[dc->c_first].e_prev = i;
+  } else {
+    dc->c_last = i;
+  }
+  dc->c_first = i;
+}
+
+/* returns 1 if key is in the window, otherwise records it and returns 0 */
+static int dedup_seen(struct since_state *sn, unsigned long long key)
+{
+  struct dedup_cache *dc;
+  struct dedup_entry *de;
+  int i, *link;
+
+  dc = &(sn->s_cache);
+
+  for(i = dc->c_heads[key & dc->c_mask]; i >= 0; i = dc->c_entries[i].e_chain){
+    if(dc->c_entries[i].e_key == key){
+      lru_unlink(dc, i);
+      lru_front(dc, i);
+      return 1;
+    }
+  }
+
+  if(dc->c_used < dc->c_size){
+    i = dc->c_used++;
+  } else {
+    /* evict least recently seen */
+    i = dc->c_last;
+    lru_unlink(dc, i);
+    for(link = &(dc->c_heads[dc->c_entries[i].e_key & dc->c_mask]); *link != i; link = &(dc->c_entries[*link].e_chain));
+    *link = dc->c_entries[i].e_chain;
+  }
+
+  de = &(dc->c_entries[i]);
+  de->e_key = key;
+  de->e_chain = dc->c_heads[key & dc->c_mask];
+  dc->c_heads[key & dc->c_mask] = i;
+  lru_front(dc, i);
+
+  return 0;
+}
+
+/* hash of the line, leaving out the parts which vary between repeats */
+static unsigned long long dedup_key(struct since_state *sn, char *line, unsigned int len)
+{
+  unsigned int i, k;
+  regmatch_t range;
+#ifndef REG_STARTEND
+  char *tmp;
+#endif
+  int result;
+
+  i = 0;
+  for(k = 0; k < sn->s_dedup_skip; k++){
+    while((i < len) && isspace((unsigned char)(line[i]))) i++;
+    while((i < len) && !isspace((unsigned char)(line[i]))) i++;
+  }
+
+  line += i;
+  len -= i;
+
+  if(sn->s_have_mask == 0){
+    return fingerprint((unsigned char *)line, len);
+  }
+
+#ifdef REG_STARTEND
+  range.rm_so = 0;
+  range.rm_eo = len;
+  result = regexec(&(sn->s_dedup_mask), line, 1, &range, REG_STARTEND);
+#else
+  tmp = malloc(len + 1);
+  if(tmp == NULL){
+    return fingerprint((unsigned char *)line, len);
+  }
+  memcpy(tmp, line, len);
+  tmp[len] = '\0';
+  result = regexec(&(sn->s_dedup_mask), tmp, 1, &range, 0);
+  free(tmp);
+#endif
+
+  if(result){
+    return fingerprint((unsigned char *)line, len);
+  }
+
+  return fingerprint((unsigned char *)line, range.rm_so) ^ (fingerprint((unsigned char *)(line + range.rm_eo), len - range.rm_eo) * 0x9e3779b97f4a7c15ULL);
+}
+
+/* tell the reader about the lines which were left out */
+static int dedup_note(struct since_state *sn, struct data_file *df)
+{
+  char tmp[MAX_FMT];
+  int len, result;
+
+  if(df->d_dup_count == 0){
+    return 0;
+  }
+
+  if(sn->s_json){
+    result = batch_text(sn, "{\"file\":\"", 9);
+    if(result == 0){
+      result = json_string(sn, df->d_name, strlen(df->d_name));
+    }
+    if(result == 0){
+      len = snprintf(tmp, MAX_FMT, "\",\"repeated\":%llu}\n", df->d_dup_count);
+      result = batch_text(sn, tmp, len);
+    }
+  } else {
+    if(sn->s_prefix_len > 0){
+      result = batch_slice(sn, sn->s_prefix, sn->s_prefix_len);
+      if(result){
+        return result;
+      }
+    }
+    if(sn->s_dedup_window){
+      len = snprintf(tmp, MAX_FMT, "%llu duplicate lines suppressed\n", df->d_dup_count);
+    } else {
+      len = snprintf(tmp, MAX_FMT, "last message repeated %llu times\n", df->d_dup_count);
+    }
+    result = batch_text(sn, tmp, len);
+  }
+
+  if(result == 0){
+    df->d_dup_count = 0;
+  }
+
+  return result;
+}
+
+/* returns 1 if the line is to be dropped */
+static int dedup_line(struct since_state *sn, struct data_file *df, char *line, unsigned int len)
+{
+  unsigned long long key;
+
+  key = dedup_key(sn, line, (line[len - 1] == '\n') ? (len - 1) : len);
+
+  if(sn->s_dedup_window){
+    /* lines of different files are never duplicates */
+    if(dedup_seen(sn, key ^ (((unsigned long long)(df - sn->s_data_files) + 1) * 0xc6a4a7935bd1e995ULL))){
+      df->d_dup_count++;
+      return 1;
+    }
+    return 0;
+  }
+
+  if((df->d_dup_key == key) && (df->d_dup_key != 0)){
+    df->d_dup_count++;
+    return 1;
+  }
+
+  df->d_dup_key = key;
+
+  if(dedup_note(sn, df) < 0){
+    return -1;
+  }
+
+  return 0;
+}
+
+/* the same prefix serves all lines of a chunk, as they arrived together */
+static void make_prefix(struct since_state *sn, struct data_file *df)
+{
+  struct timespec now;
+  struct tm tm;
+  unsigned int k;
+  long sec, nsec;
+
+  k = 0;
+
+  if(sn->s_prefixes & PREFIX_TIME){
+    clock_gettime(CLOCK_REALTIME, &now);
+    localtime_r(&(now.tv_sec), &tm);
+    k += strftime(sn->s_prefix + k, MAX_FMT / 2, "%Y-%m-%dT%H:%M:%S", &tm);
+    k += sprintf(sn->s_prefix + k, ".%09ld ", (long)(now.tv_nsec));
+  }
+
+  if(sn->s_prefixes & PREFIX_DELAY){
+    if(df->d_event.tv_sec == 0){
+      /* data predates the watch, no event to measure from */
+      memcpy(sn->s_prefix + k, "- ", 2);
+      k += 2;
+    } else {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      sec = now.tv_sec - df->d_event.tv_sec;
+      nsec = now.tv_nsec - df->d_event.tv_nsec;
+      if(nsec < 0){
+        nsec += 1000000000;
+        sec--;
+      }
+      k += sprintf(sn->s_prefix + k, "+%ld.%09ld ", sec, nsec);
+    }
+  }
+
+  if(sn->s_prefixes & PREFIX_TAG){
+    k += sprintf(sn->s_prefix + k, "%s: ", df->d_name);
+  }
+
+  sn->s_prefix_len = k;
+}
+
+/* a delimiter at pos ends the current field, runs of whitespace count as one */
+static unsigned int add_field(struct since_state *sn, unsigned int found, unsigned int *start, unsigned int pos)
+{
+  if(sn->s_delim || (pos > *start)){
+    sn->s_pick_at[found * 2] = *start;
+    sn->s_pick_at[(found * 2) + 1] = pos;
+    found++;
+  }
+  *start = pos + 1;
+
+  return found;
+}
+
+/* records where the first want fields of line start and end, returns how many there are */
+static unsigned int split_fields(struct since_state *sn, char *line, unsigned int len, unsigned int want)
+{
+  unsigned int i, start, found;
+#ifdef __SSE2__
+  __m128i delim, space, tab, v;
+  unsigned int mask;
+#endif
+
+  i = 0;
+  start = 0;
+  found = 0;
+
+#ifdef __SSE2__
+  delim = _mm_set1_epi8(sn->s_delim);
+  space = _mm_set1_epi8(' ');
+  tab = _mm_set1_epi8('\t');
+  for(; ((i + 16) <= len) && (found < want); i += 16){
+    v = _mm_loadu_si128((__m128i *)(line + i));
+    if(sn->s_delim){
+      mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, delim));
+    } else {
+      mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)));
+    }
+    while(mask && (found < want)){
+      found = add_field(sn, found, &start, i + __builtin_ctz(mask));
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for(; (i < len) && (found < want); i++){
+    if(sn->s_delim ? (line[i] == sn->s_delim) : ((line[i] == ' ') || (line[i] == '\t'))){
+      found = add_field(sn, found, &start, i);
+    }
+  }
+
+  if((found < want) && (start <= len)){
+    /* the last field has no delimiter after it */
+    found = add_field(sn, found, &start, len);
+  }
+
+  return found;
+}
+
+/* fields are handed to writev where they are, with separators between them */
+static int emit_fields(struct since_state *sn, char *line, unsigned int len)
+{
+  unsigned int i, k, found;
+  int result;
+
+  if((len > 0) && (line[len - 1] == '\n')){
+    len--;
+  }
+
+  found = split_fields(sn, line, len, sn->s_pick_max);
+
+  for(i = 0; i < sn->s_pick_count; i++){
+    if(i > 0){
+      result = batch_slice(sn, sn->s_delim ? &(sn->s_delim) : " ", 1);
+      if(result){
+        return result;
+      }
+    }
+    k = sn->s_pick[i] - 1;
+    if((k < found) && (sn->s_pick_at[(k * 2) + 1] > sn->s_pick_at[k * 2])){
+      result = batch_slice(sn, line + sn->s_pick_at[k * 2], sn->s_pick_at[(k * 2) + 1] - sn->s_pick_at[k * 2]);
+      if(result){
+        return result;
+      }
+    }
+  }
+
+  return batch_slice(sn, "\n", 1);
+}
+
+/* len includes the newline, if there is one */
+static int emit_line(struct since_state *sn, struct data_file *df, char *line, unsigned int len, off_t pos, off_t number)
+{
+  int result;
+
+  if((sn->s_sample || (sn->s_rate > 0.0)) && !sample_line(sn, line, len)){
+    df->d_dropped++;
+    return 0; /* still counts as seen */
+  }
+
+  if(sn->s_count){
+    return count_line(sn, df, line, len);
+  }
+
+  if(sn->s_dedup){
+    result = dedup_line(sn, df, line, len);
+    if(result > 0){
+      return 0;
+    }
+    if(result < 0){
+      return -1;
+    }
+  }
+
+  if(sn->s_json){
+    return emit_json(sn, df, line, (line[len - 1] == '\n') ? (len - 1) : len, pos, number);
+  }
+
+  /* the line itself is never copied, only referenced */
+  if(sn->s_prefix_len > 0){
+    result = batch_slice(sn, sn->s_prefix, sn->s_prefix_len);
+    if(result){
+      return result;
+    }
+  }
+
+  if(sn->s_pick){
+    return emit_fields(sn, line, len);
+  }
+
+  return batch_slice(sn, line, len);
+}
+
+static int record_at(struct since_state *sn, char *ptr, char *end)
+{
+  return ((end - ptr) >= sn->s_record_len) && !memcmp(ptr, sn->s_record, sn->s_record_len);
+}
+
+/* returns the start of the next record after the one at buffer, or NULL if not in buffer */
+static char *next_record(struct since_state *sn, char *buffer, unsigned int len)
+{
+  char *ptr, *end;
+#ifdef __SSE2__
+  __m128i nl, first;
+  unsigned int mask;
+#endif
+
+  ptr = buffer;
+  end = buffer + len;
+
+#ifdef __SSE2__
+  /* a newline followed by the first byte of the pattern, for 16 positions at once */
+  nl = _mm_set1_epi8('\n');
+  first = _mm_set1_epi8(sn->s_record[0]);
+  while((end - ptr) > 16){
+    mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)ptr), nl), _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(ptr + 1)), first)));
+    while(mask){
+      if(record_at(sn, ptr + __builtin_ctz(mask) + 1, end)){
+        return ptr + __builtin_ctz(mask) + 1;
+      }
+      mask &= mask - 1;
+    }
+    ptr += 16;
+  }
+#endif
+
+  for(; (ptr + 1) < end; ptr++){
+    if((ptr[0] == '\n') && record_at(sn, ptr + 1, end)){
+      return ptr + 1;
+    }
+  }
+
+  return NULL;
+}
+
+/* returns like display_buffer, an incomplete last line or record is left for later unless forced */
+static int display_lines(struct since_state *sn, struct data_file *df, char *buffer, unsigned int len, int force)
+{
+  char *ptr, *end, *next;
+  off_t pos, lines;
+  unsigned int take;
+  int result, done, quick;
+
+  ptr = buffer;
+  end = buffer + len;
+  pos = df->d_pos;
+  lines = df->d_lines;
+
+  /* a record ends where the next one starts, or when no more data is coming */
+  done = ((sn->s_follow == 0) && ((pos + len) >= df->d_now)) ? 1 : 0;
+
+  /* plain --json, nothing needs to see the line before it is written */
+  quick = (sn->s_json && !sn->s_record && !sn->s_sample && (sn->s_rate <= 0.0) && !sn->s_dedup) ? 1 : 0;
+
+  if(sn->s_prefixes){
+    make_prefix(sn, df);
+  }
+
+  while(ptr < end){
+    take = 0;
+    if(quick){
+      result = json_line(sn, df, ptr, end - ptr, pos, lines + 1, &take);
+      if(result){
+        return result;
+      }
+      next = ptr + take;
+    }
+
+    if(take == 0){
+      if(sn->s_record){
+        next = next_record(sn, ptr, end - ptr);
+        if((next == NULL) && done && (end[-1] == '\n')){
+          next = end;
+        }
+      } else {
+        next = memchr(ptr, '\n', end - ptr);
+        if(next){
+          next++;
+        }
+      }
+      if(next == NULL){
+        if((force == 0) || (ptr > buffer)){
+          break;
+        }
+        /* a line or record longer than the buffer, send it as a fragment */
+        take = end - ptr;
+      } else {
+        take = next - ptr;
+      }
+
+      result = emit_line(sn, df, ptr, take, pos, lines + 1);
+      if(result){
+        return result;
+      }
+    }
+
+    if(sn->s_record){
+      lines += count_newlines(ptr, take);
+    } else if(next){
+      lines++;
+    }
+    ptr += take;
+    pos += take;
+
+    result = batch_mark(sn, df, pos, lines);
+    if(result){
+      return result;
+    }
+
+    if(sn->s_exec && ((sn->s_exec_sent + sn->s_batch.o_bytes) >= sn->s_exec_size)){
+      result = flush_batch(sn);
+      if(result == 0){
+        result = end_batch(sn);
+      }
+      if(result){
+        return result;
+      }
+    }
+  }
+
+  /* slices refer into the buffer, which the caller is about to reuse */
+  return keep_batch(sn);
+}
+
+static int write_buffer(struct since_state *sn, struct data_file *df, char *buffer, unsigned int len)
+{
+  struct timespec t;
+  int wr, result;
+  unsigned int wt, i, back;
+
+#ifdef DEBUG
+  sleep(1);
+
+  fprintf(stderr, "display: need to display %u bytes for %s\n", len, df->d_name);
+  if(len <= 0){
+    fprintf(stderr, "since: logic failure: writing out empty string\n");
+  }
+#endif
+
+  if(sn->s_output < 0){
+    if(start_exec(sn, df)){
+      return -1;
+    }
+  }
+
+  wt = 0;
+  result = 1; /* used to infer signal */
+  since_run = 1;
+  sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
+
+  while(since_run){
+    PROF_BEGIN(sn, t);
+    wr = write(sn->s_output, buffer + wt, len - wt);
+    if(sn->s_profile){
+      prof_span(sn, &t, PROF_OUTPUT);
+      sn->s_prof.p_calls[PROF_WRITE]++;
+      if(wr > 0){
+        sn->s_prof.p_out += wr;
+        if(wr < (len - wt)){
+          sn->s_prof.p_partial++;
+        }
+      }
+    }
+    switch(wr){
+      case -1 :
+#ifdef DEBUG
+        fprintf(stderr, "display: write failed: %s\n", strerror(errno));
+#endif
+        switch(errno){
+          case EINTR :
+          case EPIPE :
+            since_run = 0;
+            result = 1;
+            break;
+          case EAGAIN :
+            if(wait_output(sn)){
+              since_run = 0;
+              result = (-1);
+            }
+            break;
+          default :
+            /* unlikely to do anything */
+            fprintf(stderr, "since: unable to display output: %s\n", strerror(errno));
+            since_run = 0;
+            result = (-1);
+        }
+        break;
+      case 0 :
+        /* WARNING: unsure how to deal with this one, should we exit */
+        break;
+      default :
+        wt += wr;
+        sn->s_exec_sent += wr;
+        sn->s_exec_total += wr;
+        if(wt >= len){
+          since_run = 0;
+          result = 0;
+        }
+        break;
+    }
+  }
+
+  sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
+  since_run = 1;
+
+#ifdef DEBUG
+  fprintf(stderr, "display: final code is %d, wt %u\n", result, wt);
+#endif
+
+  if(result < 0){ /* conventional error */
+    return (-1);
+  }
+
+  if(result == 0){ /* success */
+    df->d_pos += len;
+    df->d_lines = (-1); /* plain output leaves the data untouched, count again if needed */
+    df->d_write = 1;
+    return 0;
+  }
+
+  /* user interrupt */
+
+  if(wt <= 0){
+    return 1;
+  }
+
+  /* no guarantees, just trying to restart on a new line */
+  back = (wt <= LINE_SEARCH) ? 0 : (wt - LINE_SEARCH);
+  i = wt;
+
+  do{
+    i--;
+    if(buffer[i] == '\n'){
+#ifdef DEBUG
+      fprintf(stderr, "recover: to newline at %u\n", i);
+#endif
+      wt = i + 1;
+      break;
+    }
+  } while(i > back);
+
+#ifdef DEBUG
+  fprintf(stderr, "interrupt: at position %u\n", wt);
+#endif
+
+  df->d_pos += wt;
+  df->d_lines = (-1);
+  df->d_write = 1;
+
+  return 1;
+}
+
+/* hand the command pieces which end on a line, so that a batch holds whole lines */
+static int exec_buffer(struct since_state *sn, struct data_file *df, char *buffer, unsigned int len)
+{
+  unsigned int take, room;
+  int result;
+
+  while(len > 0){
+    room = (sn->s_exec_sent < sn->s_exec_size) ? (sn->s_exec_size - sn->s_exec_sent) : 1;
+    take = len;
+    if(take > room){
+      take = room;
+      while((take > 0) && (buffer[take - 1] != '\n')){
+        take--;
+      }
+      if(take == 0){
+        /* a line longer than the batch, let it run over */
+        take = room;
+        while((take < len) && (buffer[take - 1] != '\n')){
+          take++;
+        }
+      }
+    }
+
+    result = write_buffer(sn, df, buffer, take);
+    if(result){
+      return result;
+    }
+
+    result = exec_check(sn);
+    if(result){
+      return result;
+    }
+
+    buffer += take;
+    len -= take;
+  }
+
+  return 0;
+}
+
+static int display_buffer(struct since_state *sn, struct data_file *df, char *buffer, unsigned int len)
+{
+  int result;
+
+  if(sn->s_lines){
+    return display_lines(sn, df, buffer, len, 0);
+  }
+
+  if(sn->s_count){
+    return count_buffer(sn, df, buffer, len);
+  }
+
+  if(sn->s_exec){
+    return exec_buffer(sn, df, buffer, len);
+  }
+
+  if(sn->s_gather && (len <= OUTPUT_GATHER)){
+    /* small appends to many files go out together */
+    result = batch_text(sn, buffer, len);
+    if(result){
+      return result;
+    }
+    return batch_mark(sn, df, df->d_pos + len, (-1));
+  }
+
+  /* anything queued goes first */
+  result = flush_batch(sn);
+  if(result){
+    return result;
+  }
+
+  return write_buffer(sn, df, buffer, len);
+}
+
+/* checks common to all ways of reading, the header is left to the caller */
+static int begin_file(struct since_state *sn, struct data_file *df, off_t *range)
+{
+  /* WARNING: should not manipulate d_had here, should be done in lookup and refresh, maybe pos resets too */
+  if(df->d_had > df->d_now){
+    fprintf(stderr, "since: considering %s to be truncated, displaying from start\n", df->d_name);
+    df->d_had = 0;
+    /* WARNING: d_pos gets saved, not d_had */
+    df->d_write = 1;
+  }
+
+  if(df->d_pos < df->d_had){
+    df->d_jump = 1;
+    df->d_pos = df->d_had;
+    df->d_lines = (-1);
+  }
+
+#ifdef DEBUG
+  if(df->d_pos > df->d_now){
+    fprintf(stderr, "since: logic failure - position pointer has overtaken length\n");
+    abort();
+  }
+#endif
+
+  *range = df->d_now - df->d_pos;
+  if(*range == 0){
+    return 0;
+  }
+
+  sn->s_current = df;
+
+  if(sn->s_hints){
+    /* only advisory, failures do not matter */
+    posix_fadvise(df->d_fd, df->d_pos, *range, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(df->d_fd, df->d_pos, (*range < ADVISE_AHEAD) ? *range : ADVISE_AHEAD, POSIX_FADV_WILLNEED);
+  }
+
+  if(sn->s_lines && (df->d_lines < 0)){
+    /* line numbers unknown, eg after -z or from an old state file */
+    if(count_lines(sn, df)){
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int pick_engine(struct since_state *sn, off_t range)
+{
+  int raw;
+
+  /* splice hands the data over unseen, only possible without line processing */
+  raw = ((sn->s_lines == 0) && (sn->s_count == 0) && (sn->s_exec == NULL) && sn->s_to_pipe) ? 1 : 0;
+
+  switch(sn->s_engine){
+    case ENGINE_SPLICE :
+      return raw ? ENGINE_SPLICE : ENGINE_READ;
+    case ENGINE_MMAP :
+    case ENGINE_READ :
+      return sn->s_engine;
+  }
+
+  if(raw && (range >= SPLICE_MIN)){
+    return ENGINE_SPLICE;
+  }
+
+  if(sn->s_domap && (range > MAP_MIN)){
+    return ENGINE_MMAP;
+  }
+
+  return ENGINE_READ;
+}
+
+/* grow the read buffer, returns its size */
+static unsigned int grow_read(struct since_state *sn)
+{
+  char *tmp;
+  unsigned int size;
+
+  if(sn->s_read == NULL){
+    size = (sn->s_read_max < READ_START) ? sn->s_read_max : READ_START;
+  } else if(sn->s_read_size < sn->s_read_max){
+    size = ((sn->s_read_size * 2) > sn->s_read_max) ? sn->s_read_max : (sn->s_read_size * 2);
+  } else {
+    return sn->s_read_size;
+  }
+
+  /* aligned, which the kernel can copy into more cheaply */
+  if(posix_memalign((void **)&tmp, IO_BUFFER, size)){
+    return sn->s_read_size; /* make do with what we have */
+  }
+
+  if(sn->s_verbose > 2){
+    fprintf(stderr, "since: read buffer now %u bytes\n", size);
+  }
+
+  if(sn->s_read){
+    free(sn->s_read);
+  }
+  sn->s_read = tmp;
+  sn->s_read_size = size;
+
+  return size;
+}
+
+/* returns like display_buffer, leaves the rest to the read path if splice is refused */
+static int splice_file(struct since_state *sn, struct data_file *df)
+{
+  struct timespec t;
+  loff_t from;
+  ssize_t wr;
+  int result;
+
+  result = flush_batch(sn);
+  if(result){
+    return result;
+  }
+
+  from = df->d_pos;
+  result = 1; /* used to infer signal */
+  since_run = 1;
+  sigprocmask(SIG_UNBLOCK, &(sn->s_set), NULL);
+
+  while(since_run && (from < df->d_now)){
+    PROF_BEGIN(sn, t);
+    wr = splice(df->d_fd, &from, sn->s_output, NULL, ((df->d_now - from) > READ_MAX) ? READ_MAX : (df->d_now - from), SPLICE_F_MORE);
+    if(sn->s_profile){
+      prof_span(sn, &t, PROF_OUTPUT);
+      sn->s_prof.p_calls[PROF_SPLICE]++;
+      if(wr > 0){
+        sn->s_prof.p_in += wr;
+        sn->s_prof.p_out += wr;
+      }
+    }
+    if(wr < 0){
+      switch(errno){
+        case EINTR :
+        case EPIPE :
+          since_run = 0;
+          result = 1;
+          break;
+        case EAGAIN :
+          break;
+        case EINVAL :
+          if(from == df->d_pos){
+            /* eg output opened for append, let read deal with it */
+            if(sn->s_verbose > 1){
+              fprintf(stderr, "since: unable to splice, reading instead\n");
+            }
+            sn->s_to_pipe = 0;
+            since_run = 0;
+            result = 0;
+            break;
+          }
+          /* else fall */
+        default :
+          fprintf(stderr, "since: unable to display output: %s\n", strerror(errno));
+          since_run = 0;
+          result = (-1);
+      }
+      continue;
+    }
+    if(wr == 0){
+      break; /* file shrank, caught later */
+    }
+  }
+
+  if(since_run){
+    result = 0;
+  }
+
+  sigprocmask(SIG_BLOCK, &(sn->s_set), NULL);
+  since_run = 1;
+
+  if(from > df->d_pos){
+    df->d_pos = from;
+    df->d_lines = (-1); /* data not seen, count again if needed */
+    df->d_write = 1;
+  }
+  df->d_jump = 1;
+
+  return result;
+}
+
+/* returns the last newline in buffer, or NULL */
+static char *last_newline(char *buffer, unsigned int len)
+{
+  char *end;
+#ifdef __SSE2__
+  __m128i nl, a, b, c, d;
+  unsigned int mask;
+#endif
+
+  end = buffer + len;
+
+#ifdef __SSE2__
+  nl = _mm_set1_epi8('\n');
+  while((end - buffer) >= 64){
+    a = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(end - 16)), nl);
+    b = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(end - 32)), nl);
+    c = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(end - 48)), nl);
+    d = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(end - 64)), nl);
+    /* one test per 64 bytes, then narrow down from the back */
+    if(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))){
+      if((mask = _mm_movemask_epi8(a)) != 0){
+        return end - 16 + (31 - __builtin_clz(mask));
+      }
+      if((mask = _mm_movemask_epi8(b)) != 0){
+        return end - 32 + (31 - __builtin_clz(mask));
+      }
+      if((mask = _mm_movemask_epi8(c)) != 0){
+        return end - 48 + (31 - __builtin_clz(mask));
+      }
+      mask = _mm_movemask_epi8(d);
+      return end - 64 + (31 - __builtin_clz(mask));
+    }
+    end -= 64;
+  }
+#endif
+
+  return memrchr(buffer, '\n', end - buffer);
+}
+
+static int read_back(struct since_state *sn, struct data_file *df, char *buffer, unsigned int len, off_t offset)
+{
+  if(read_range(df, (unsigned char *)buffer, len, offset)){
+    fprintf(stderr, "since: unable to read from %s: %s\n", df->d_name, (errno == 0) ? "unexpected eof" : strerror(errno));
+    return -1;
+  }
+
+  if(sn->s_profile){
+    sn->s_prof.p_calls[PROF_PREAD]++;
+    sn->s_prof.p_in += len;
+  }
+
+  return 0;
+}
+
+/* a line longer than the buffer, ending at end: look back for its start, then send it in pieces from there */
+static int reverse_long(struct since_state *sn, struct data_file *df, off_t *start, off_t end, off_t number)
+{
+  char *nl;
+  off_t at;
+  unsigned int n;
+  int result;
+
+  for(at = *start; at > df->d_pos; at -= n){
+    n = ((at - df->d_pos) < sn->s_read_size) ? (at - df->d_pos) : sn->s_read_size;
+    errno = 0;
+    if(read_back(sn, df, sn->s_read, n, at - n)){
+      return -1;
+    }
+    nl = last_newline(sn->s_read, n);
+    if(nl){
+      at = at - n + (nl - sn->s_read) + 1;
+      break;
+    }
+  }
+
+  *start = at;
+
+  for(; at < end; at += n){
+    n = ((end - at) < sn->s_read_size) ? (end - at) : sn->s_read_size;
+    errno = 0;
+    if(read_back(sn, df, sn->s_read, n, at)){
+      return -1;
+    }
+    result = emit_line(sn, df, sn->s_read, n, at, number);
+    if(result == 0){
+      result = flush_batch(sn);
+    }
+    if(result){
+      return result;
+    }
+  }
+
+  return 0;
+}
+
+/* returns like display_buffer, complete lines newest first, only recorded as seen once all are out */
+static int reverse_file(struct since_state *sn, struct data_file *df)
+{
+  char *buffer, *nl;
+  off_t lo, end, number, lines;
+  unsigned int size, r, e, i, n;
+  int result;
+
+  size = (sn->s_read == NULL) ? grow_read(sn) : sn->s_read_size;
+  while((sn->s_read != NULL) && (size < (df->d_now - df->d_pos)) && (size < sn->s_read_max)){
+    n = grow_read(sn);
+    if(n == size){
+      break;
+    }
+    size = n;
+  }
+  if(sn->s_read == NULL){
+    fprintf(stderr, "since: unable to allocate read buffer\n");
+    return -1;
+  }
+  buffer = sn->s_read;
+
+  number = df->d_lines;
+  if(sn->s_json){
+    /* numbers count down from the newest line, so the total is needed first */
+    for(lo = df->d_pos; lo < df->d_now; lo += n){
+      n = ((df->d_now - lo) < size) ? (df->d_now - lo) : size;
+      errno = 0;
+      if(read_back(sn, df, buffer, n, lo)){
+        return -1;
+      }
+      number += count_newlines(buffer, n);
+    }
+  }
+
+  if(sn->s_prefixes){
+    make_prefix(sn, df);
+  }
+
+  /* buffer[r, size) holds the file from lo onwards, a line ending at the back */
+  lo = df->d_now;
+  r = size;
+  end = (-1);
+  lines = 0;
+
+  while(lo > df->d_pos){
+    if(r == 0){
+      /* the piece held fills the buffer */
+      result = reverse_long(sn, df, &lo, lo + size, number);
+      if(result){
+        return result;
+      }
+      number--;
+      lines++;
+      r = size;
+      continue;
+    }
+
+    n = ((lo - df->d_pos) < r) ? (lo - df->d_pos) : r;
+    lo -= n;
+    r -= n;
+    errno = 0;
+    if(read_back(sn, df, buffer + r, n, lo)){
+      return -1;
+    }
+
+    e = size;
+    if(end < 0){
+      nl = last_newline(buffer + r, size - r);
+      if(nl == NULL){
+        r = size; /* all of an incomplete last line, left for later */
+        continue;
+      }
+      e = (nl - buffer) + 1;
+      end = lo + (e - r);
+    }
+
+    while(e > r){
+      nl = last_newline(buffer + r, e - 1 - r);
+      if(nl){
+        i = (nl - buffer) + 1;
+      } else if(lo <= df->d_pos){
+        i = r;
+      } else {
+        break; /* starts in data not yet read */
+      }
+      result = emit_line(sn, df, buffer + i, e - i, lo + (i - r), number);
+      if(result){
+        return result;
+      }
+      number--;
+      lines++;
+      e = i;
+    }
+
+    /* slices refer into the buffer, so flush before reading into it again */
+    result = flush_batch(sn);
+    if(result){
+      return result;
+    }
+
+    /* keep the end of the line cut off, and read what comes before it */
+    if(e > r){
+      memmove(buffer + size - (e - r), buffer + r, e - r);
+    }
+    r = size - (e - r);
+  }
+
+  df->d_jump = 1;
+  if(end > df->d_pos){
+    df->d_pos = end;
+    df->d_lines += lines;
+    df->d_write = 1;
+  }
+
+  return 0;
+}
+
+static int display_file(struct since_state *sn, struct data_file *df, int single)
+{
+  char *ptr;
+  int rr, result, held, engine, force;
+  off_t range, at;
+  unsigned int fixup, size;
+
+  if(begin_file(sn, df, &range)){
+    return -1;
+  }
+
+  if(range == 0){
+    display_header(sn, df, single, 0);
+    return 0;
+  }
+
+  if(sn->s_reverse){
+    display_header(sn, df, single, 0);
+    return reverse_file(sn, df);
+  }
+
+  engine = pick_engine(sn, range);
+  if(sn->s_verbose > 1){
+    fprintf(stderr, "since: using %s for %llu bytes of %s\n", engine_names[engine], (unsigned long long)range, df->d_name);
+  }
+
+  if(engine == ENGINE_SPLICE){
+    display_header(sn, df, single, 0);
+    result = splice_file(sn, df);
+    if(result || (df->d_pos >= df->d_now)){
+      return result;
+    }
+    /* refused, continue below */
+  }
+
+  if(engine == ENGINE_MMAP){
+    fixup = df->d_pos & (IO_BUFFER - 1);
+    ptr = mmap(NULL, range + fixup, PROT_READ, MAP_PRIVATE, df->d_fd, df->d_pos - fixup);
+    PROF_CALL(sn, PROF_MMAP);
+    if((void *)(ptr) != MAP_FAILED){
+      if(sn->s_profile){
+        sn->s_prof.p_in += range;
+      }
+      if(sn->s_hints){
+        madvise(ptr, range + fixup, MADV_SEQUENTIAL);
+      }
+
+      display_header(sn, df, single, 0);
+
+      result = display_buffer(sn, df, ptr + fixup, range);
+      df->d_jump = 1;
+      munmap(ptr, range + fixup);
+
+      return result;
+    }
+    if(sn->s_verbose > 1){
+      fprintf(stderr, "since: unable to map %s, reading instead: %s\n", df->d_name, strerror(errno));
+    }
+  }
+
+  if(df->d_jump){
+    PROF_CALL(sn, PROF_LSEEK);
+    if(lseek(df->d_fd, df->d_pos, SEEK_SET) != df->d_pos){
+      fprintf(stderr, "since: unable to seek in file %s: %s\n", df->d_name, strerror(errno));
+      return -1;
+    }
+    df->d_jump = 0;
+  }
+
+  if(engine != ENGINE_SPLICE){
+    display_header(sn, df, single, 0);
+  }
+
+  size = (sn->s_read == NULL) ? grow_read(sn) : sn->s_read_size;
+  if(sn->s_read == NULL){
+    fprintf(stderr, "since: unable to allocate read buffer\n");
+    return -1;
+  }
+
+  held = 0;
+  df->d_write = 1;
+  while((df->d_pos < df->d_now) && (held == 0)){
+    rr = read(df->d_fd, sn->s_read, size);
+    if(sn->s_profile){
+      sn->s_prof.p_calls[PROF_READ]++;
+      if(rr > 0){
+        sn->s_prof.p_in += rr;
+      }
+    }
+    switch(rr){
+      case -1 :
+        switch(errno){
+          case EAGAIN :
+          case EINTR  :
+            break;
+          default :
+            fprintf(stderr, "since: unable to read from %s: %s\n", df->d_name, strerror(errno));
+            return -1;
+        }
+        break;
+      case  0 :
+        fprintf(stderr, "since: unexpected eof while reading from %s\n", df->d_name);
+        break;
+      default :
+        at = df->d_pos;
+        if(sn->s_lines == 0){
+          result = display_buffer(sn, df, sn->s_read, rr);
+          if(result != 0){
+            return result;
+          }
+        } else {
+          /* only split a line if it does not fit into the largest buffer */
+          force = ((rr == size) && (size >= sn->s_read_max) && ((at + rr) < df->d_now)) ? 1 : 0;
+          result = display_lines(sn, df, sn->s_read, rr, force);
+          if(result != 0){
+            return result;
+          }
+          if(df->d_pos < (at + rr)){
+            df->d_jump = 1;
+            if((at + rr) >= df->d_now){
+              held = 1; /* incomplete last line, keep it for later */
+            } else {
+              PROF_CALL(sn, PROF_LSEEK);
+              if(lseek(df->d_fd, df->d_pos, SEEK_SET) != df->d_pos){
+                fprintf(stderr, "since: unable to seek in file %s: %s\n", df->d_name, strerror(errno));
+                return -1;
+              }
+              df->d_jump = 0;
+            }
+          }
+        }
+        if((rr == size) && ((at + rr) < df->d_now)){
+          /* more to come, fewer and larger reads */
+          size = grow_read(sn);
+        }
+        break;
+    }
+  }
+
+  if(df->d_now < df->d_pos){
+    /* in case more gets append to file while reading */
+    df->d_now = df->d_pos;
+  }
+
+  return 0;
+}
+
+/* per file work once its new data has been displayed */
+static int finish_file(struct since_state *sn, struct data_file *df)
+{
+  int result;
+
+  if(df->d_pos >= df->d_now){
+    df->d_event.tv_sec = 0; /* caught up, next growth starts a new delay */
+  }
+  if(df->d_dropped && (sn->s_verbose > 1)){
+    fprintf(stderr, "since: sampling left out %llu lines of %s\n", df->d_dropped, df->d_name);
+    df->d_dropped = 0;
+  }
+  if(df->d_dup_count > 0){
+    /* report at the end of each round, instead of waiting for a different line */
+    result = dedup_note(sn, df);
+    if(result == 0){
+      result = keep_batch(sn);
+    }
+    if(result){
+      return result;
+    }
+  }
+  if(sn->s_exec && (sn->s_coprocess == 0) && (sn->s_exec_sent > 0)){
+    /* a command run is given the data of a single file */
+    result = end_batch(sn);
+    if(result){
+      return result;
+    }
+  }
+
+  return 0;
+}
+
+static int display_files(struct since_state *sn)
+{
+  struct data_file *df;
+  struct timespec t;
+  unsigned int i;
+  int result, single;
+
+#ifdef DEBUG
+  fprintf(stderr, "display: have %u files to display\n", sn->s_data_count);
+#endif
+
+  single = (sn->s_data_count == 1)  ? 1 : 0;
+
+#ifdef USE_URING
+  if(sn->s_uring){
+    /* requests for all files overlap, so only the total is timed */
+    PROF_BEGIN(sn, t);
+    result = ring_files(sn, single);
+    PROF_END(sn, t, PROF_DISPLAY);
+    if(result){
+      return result;
+    }
+  } else
+#endif
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    PROF_BEGIN(sn, t);
+    result = display_file(sn, df, single);
+    if(sn->s_profile){
+      df->d_prof += prof_span(sn, &t, PROF_DISPLAY);
+    }
+    if(result == 0){
+      result = finish_file(sn, df);
+    }
+    if(result){
+      return result;
+    }
+  }
+
+  /* at most one round late */
+  result = flush_batch(sn);
+  if(result){
+    return result;
+  }
+
+  if(sn->s_count){
+    report_counts(sn);
+  }
+
+  if(sn->s_coprocess && (sn->s_exec_sent > 0)){
+    return end_batch(sn);
+  }
+
+  return 0;
+}
+
+/* io_uring reader ******************************************/
+
+#ifdef USE_URING
+static int ring_setup(struct since_state *sn)
+{
+  struct uring *ur;
+  struct io_uring_params params;
+  unsigned char *sq, *cq;
+  unsigned int i;
+
+  ur = &(sn->s_ring);
+
+  memset(&params, 0, sizeof(struct io_uring_params));
+  ur->u_fd = syscall(__NR_io_uring_setup, RING_DEPTH, &params);
+  if(ur->u_fd < 0){
+    /* old kernel, seccomp or disabled by sysctl */
+    if(sn->s_verbose > 1){
+      fprintf(stderr, "since: io_uring unavailable, using read instead: %s\n", strerror(errno));
+    }
+    return 1;
+  }
+
+  ur->u_sq_size = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+  ur->u_cq_size = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+  ur->u_sqe_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  ur->u_sq_map = mmap(NULL, ur->u_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->u_fd, IORING_OFF_SQ_RING);
+  ur->u_cq_map = mmap(NULL, ur->u_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->u_fd, IORING_OFF_CQ_RING);
+  ur->u_sqes = mmap(NULL, ur->u_sqe_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur->u_fd, IORING_OFF_SQES);
+
+  if((ur->u_sq_map == MAP_FAILED) || (ur->u_cq_map == MAP_FAILED) || ((void *)(ur->u_sqes) == MAP_FAILED)){
+    fprintf(stderr, "since: unable to map io_uring: %s\n", strerror(errno));
+    return -1;
+  }
+
+  sq = ur->u_sq_map;
+  ur->u_sq_head = (unsigned int *)(sq + params.sq_off.head);
+  ur->u_sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+  ur->u_sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+  ur->u_sq_array = (unsigned int *)(sq + params.sq_off.array);
+
+  cq = ur->u_cq_map;
+  ur->u_cq_head = (unsigned int *)(cq + params.cq_off.head);
+  ur->u_cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+  ur->u_cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+  ur->u_cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  for(i = 0; i < RING_DEPTH; i++){
+    if(posix_memalign((void **)&(ur->u_slots[i].q_buffer), IO_BUFFER, RING_CARRY + RING_CHUNK)){
+      fprintf(stderr, "since: unable to allocate read buffers\n");
+      return -1;
+    }
+    ur->u_slots[i].q_done = 0;
+  }
+
+  ur->u_carry = malloc(RING_CARRY);
+  if(ur->u_carry == NULL){
+    fprintf(stderr, "since: unable to allocate read buffers\n");
+    return -1;
+  }
+
+  ur->u_pending = 0;
+  ur->u_head = 0;
+  ur->u_count = 0;
+
+  if(sn->s_verbose > 2){
+    fprintf(stderr, "since: reading with io_uring, %u requests of %u bytes in flight\n", RING_DEPTH, RING_CHUNK);
+  }
+
+  return 0;
+}
+
+static void ring_destroy(struct since_state *sn)
+{
+  struct uring *ur;
+  unsigned int i;
+
+  ur = &(sn->s_ring);
+
+  if(ur->u_fd < 0){
+    return;
+  }
+
+  for(i = 0; i < RING_DEPTH; i++){
+    free(ur->u_slots[i].q_buffer);
+  }
+  free(ur->u_carry);
+
+  munmap(ur->u_sqes, ur->u_sqe_size);
+  munmap(ur->u_cq_map, ur->u_cq_size);
+  munmap(ur->u_sq_map, ur->u_sq_size);
+
+  close(ur->u_fd);
+  ur->u_fd = (-1);
+}
+
+/* queue a read of len bytes at offset into slot k, submitted later by ring_enter */
+static void ring_queue(struct since_state *sn, unsigned int k, unsigned int index, off_t offset, unsigned int len)
+{
+  struct uring *ur;
+  struct ring_slot *rs;
+  struct io_uring_sqe *sqe;
+  unsigned int tail, at;
+
+  ur = &(sn->s_ring);
+  rs = &(ur->u_slots[k]);
+
+  rs->q_index = index;
+  rs->q_offset = offset;
+  rs->q_vector.iov_base = rs->q_buffer + RING_CARRY;
+  rs->q_vector.iov_len = len;
+  rs->q_done = 0;
+
+  tail = *(ur->u_sq_tail);
+  at = tail & *(ur->u_sq_mask);
+
+  sqe = &(ur->u_sqes[at]);
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  /* readv rather than read, works on the first kernels with io_uring */
+  sqe->opcode = IORING_OP_READV;
+  sqe->fd = sn->s_data_files[index].d_fd;
+  sqe->off = offset;
+  sqe->addr = (unsigned long)&(rs->q_vector);
+  sqe->len = 1;
+  sqe->user_data = k;
+
+  ur->u_sq_array[at] = at;
+  __atomic_store_n(ur->u_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  ur->u_pending++;
+}
+
+/* submit what is queued, wait for at least one completion if asked */
+static int ring_enter(struct since_state *sn, int wait)
+{
+  struct uring *ur;
+  struct io_uring_cqe *cqe;
+  unsigned int head;
+  int result;
+
+  ur = &(sn->s_ring);
+
+  if(ur->u_pending || wait){
+    PROF_CALL(sn, PROF_URING);
+    result = syscall(__NR_io_uring_enter, ur->u_fd, ur->u_pending, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if(result < 0){
+      if(errno == EINTR){
+        return 0;
+      }
+      fprintf(stderr, "since: io_uring submission failed: %s\n", strerror(errno));
+      return -1;
+    }
+    ur->u_pending -= result;
+  }
+
+  head = *(ur->u_cq_head);
+  while(head != __atomic_load_n(ur->u_cq_tail, __ATOMIC_ACQUIRE)){
+    cqe = &(ur->u_cqes[head & *(ur->u_cq_mask)]);
+    ur->u_slots[cqe->user_data].q_result = cqe->res;
+    ur->u_slots[cqe->user_data].q_done = 1;
+    head++;
+  }
+  __atomic_store_n(ur->u_cq_head, head, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+/* reads may not outlive the buffers, so collect everything outstanding */
+static void ring_drain(struct since_state *sn)
+{
+  struct uring *ur;
+
+  ur = &(sn->s_ring);
+
+  while(ur->u_count > 0){
+    while(ur->u_slots[ur->u_head].q_done == 0){
+      if(ring_enter(sn, 1) < 0){
+        return;
+      }
+    }
+    ur->u_head = (ur->u_head + 1) % RING_DEPTH;
+    ur->u_count--;
+  }
+}
+
+/* reads ahead across files, output still happens in file order */
+static int ring_files(struct since_state *sn, int single)
+{
+  struct uring *ur;
+  struct ring_slot *rs;
+  struct data_file *df;
+  unsigned int next, current, carry, total, left, len;
+  off_t at, range;
+  char *data;
+  int result;
+
+  ur = &(sn->s_ring);
+
+  for(next = 0; next < sn->s_data_count; next++){
+    df = &(sn->s_data_files[next]);
+    if(begin_file(sn, df, &range)){
+      return -1;
+    }
+    if(range > 0){
+      df->d_jump = 1; /* file offset is left untouched */
+      df->d_write = 1;
+    }
+  }
+
+  next = 0;
+  at = sn->s_data_files[0].d_pos;
+  current = 0;
+  carry = 0;
+  result = 0;
+
+  display_header(sn, &(sn->s_data_files[0]), single, 0);
+
+  for(;;){
+    /* keep the queue full */
+    while((ur->u_count < RING_DEPTH) && (next < sn->s_data_count)){
+      df = &(sn->s_data_files[next]);
+      if(at >= df->d_now){
+        next++;
+        if(next < sn->s_data_count){
+          at = sn->s_data_files[next].d_pos;
+        }
+        continue;
+      }
+      len = ((df->d_now - at) < RING_CHUNK) ? (df->d_now - at) : RING_CHUNK;
+      ring_queue(sn, (ur->u_head + ur->u_count) % RING_DEPTH, next, at, len);
+      ur->u_count++;
+      at += len;
+    }
+
+    if(ur->u_count == 0){
+      break;
+    }
+
+    rs = &(ur->u_slots[ur->u_head]);
+    if(ring_enter(sn, rs->q_done ? 0 : 1) < 0){
+      result = (-1);
+      break;
+    }
+    if(rs->q_done == 0){
+      continue;
+    }
+
+    if((rs->q_result == (-EAGAIN)) || (rs->q_result == (-EINTR))){
+      ring_queue(sn, ur->u_head, rs->q_index, rs->q_offset, rs->q_vector.iov_len);
+      continue;
+    }
+
+    ur->u_head = (ur->u_head + 1) % RING_DEPTH;
+    ur->u_count--;
+
+    while(current < rs->q_index){
+      result = finish_file(sn, &(sn->s_data_files[current]));
+      if(result){
+        break;
+      }
+      current++;
+      carry = 0;
+      display_header(sn, &(sn->s_data_files[current]), single, 0);
+    }
+    if(result){
+      break;
+    }
+
+    df = &(sn->s_data_files[current]);
+
+    if(rs->q_result < 0){
+      fprintf(stderr, "since: unable to read from %s: %s\n", df->d_name, strerror(-(rs->q_result)));
+      result = (-1);
+      break;
+    }
+
+    if((rs->q_result == 0) || (df->d_pos != (rs->q_offset - carry))){
+      /* an earlier read came up short, or output stopped */
+      continue;
+    }
+
+    data = rs->q_buffer + RING_CARRY - carry;
+    memcpy(data, ur->u_carry, carry);
+    total = carry + rs->q_result;
+    carry = 0;
+    if(sn->s_profile){
+      sn->s_prof.p_in += rs->q_result;
+    }
+
+    sn->s_current = df;
+    result = display_buffer(sn, df, data, total);
+    if(result){
+      break;
+    }
+
+    left = (rs->q_offset + rs->q_result) - df->d_pos;
+    if((left > 0) && ((rs->q_offset + rs->q_result) < df->d_now)){
+      /* incomplete line which continues in the next chunk */
+      if(left > RING_CARRY){
+        result = display_lines(sn, df, data + total - left, left, 1);
+        if(result){
+          break;
+        }
+      } else {
+        memcpy(ur->u_carry, data + total - left, left);
+        carry = left;
+      }
+    }
+  }
+
+  ring_drain(sn);
+
+  if(result){
+    return result;
+  }
+
+  while(current < sn->s_data_count){
+    result = finish_file(sn, &(sn->s_data_files[current]));
+    if(result){
+      return result;
+    }
+    current++;
+    if(current < sn->s_data_count){
+      display_header(sn, &(sn->s_data_files[current]), single, 0);
+    }
+  }
+
+  return 0;
+}
+#endif
+
+/* discard data **********************************************/
+
+static void discard_files(struct since_state *sn)
+{
+  unsigned int i;
+  struct data_file *df;
+  int single;
+
+#ifdef DEBUG
+  fprintf(stderr, "display: have %u files to display\n", sn->s_data_count);
+#endif
+
+  single = (sn->s_data_count == 1)  ? 1 : 0;
+
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+
+    display_header(sn, df, single, 1);
+
+    if(df->d_pos != df->d_now){
+      df->d_pos = df->d_now;
+      df->d_lines = (-1);
+      df->d_jump = 1;
+      df->d_write = 1;
+    }
+  }
+
+  flush_batch(sn);
+}
+
+/* garbage collect stale records ***************************/
+
+#define GC_KEEP  1
+#define GC_DROP  2
+#define GC_STAMP 3
+
+struct inode_set{
+  struct inode_key *i_keys;
+  unsigned int i_count;
+  unsigned int i_size;
+};
+
+static int compare_inode_key(const void *a, const void *b)
+{
+  const struct inode_key *ka, *kb;
+
+  ka = a;
+  kb = b;
+
+  if(ka->i_dev != kb->i_dev){
+    return (ka->i_dev < kb->i_dev) ? -1 : 1;
+  }
+  if(ka->i_ino != kb->i_ino){
+    return (ka->i_ino < kb->i_ino) ? -1 : 1;
+  }
+
+  return 0;
+}
+
+static int add_inode_key(struct inode_set *is, dev_t dev, ino_t ino)
+{
+  struct inode_key *tmp;
+  unsigned int size;
+
+  if(is->i_count >= is->i_size){
+    size = (is->i_size > 0) ? (is->i_size * 2) : 64;
+    tmp = realloc(is->i_keys, sizeof(struct inode_key) * size);
+    if(tmp == NULL){
+      fprintf(stderr, "since: unable to allocate %lu bytes for inode set\n", (unsigned long)(sizeof(struct inode_key) * size));
+      return -1;
+    }
+    is->i_keys = tmp;
+    is->i_size = size;
+  }
+
+  is->i_keys[is->i_count].i_dev = dev;
+  is->i_keys[is->i_count].i_ino = ino;
+  is->i_count++;
+
+  return 0;
+}
+
+static int scan_directory(struct since_state *sn, char *name, struct inode_set *dirs, struct inode_set *entries)
+{
+  char path[PATH_MAX], *ptr;
+  struct dirent *de;
+  struct stat st;
+  unsigned int i, len;
+  DIR *dir;
+
+  ptr = strrchr(name, '/');
+  if(ptr == NULL){
+    strcpy(path, ".");
+  } else {
+    len = (ptr == name) ? 1 : (ptr - name);
+    if(len >= PATH_MAX){
+      fprintf(stderr, "since: directory of %s exceeds limits\n", name);
+      return -1;
+    }
+    memcpy(path, name, len);
+    path[len] = '\0';
+  }
+
+  dir = opendir(path);
+  if(dir == NULL){
+    fprintf(stderr, "since: unable to open directory %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  if(fstat(dirfd(dir), &st)){
+    fprintf(stderr, "since: unable to stat directory %s: %s\n", path, strerror(errno));
+    closedir(dir);
+    return -1;
+  }
+
+  for(i = 0; i < dirs->i_count; i++){
+    if((dirs->i_keys[i].i_dev == st.st_dev) && (dirs->i_keys[i].i_ino == st.st_ino)){
+      closedir(dir);
+      return 0; /* seen this one already */
+    }
+  }
+
+  if(add_inode_key(dirs, st.st_dev, st.st_ino)){
+    closedir(dir);
+    return -1;
+  }
+
+  if(sn->s_verbose > 2){
+    fprintf(stderr, "since: scanning %s for live inodes\n", path);
+  }
+
+  while((de = readdir(dir)) != NULL){
+    /* readdir inode numbers are unreliable across mounts and overlays */
+    if(fstatat(dirfd(dir), de->d_name, &st, AT_SYMLINK_NOFOLLOW)){
+      continue;
+    }
+    if(!S_ISREG(st.st_mode)){
+      continue;
+    }
+    if(add_inode_key(entries, st.st_dev, st.st_ino)){
+      closedir(dir);
+      return -1;
+    }
+  }
+
+  closedir(dir);
+
+  return 0;
+}
+
+static int gc_state_file(struct since_state *sn)
+{
+  struct inode_set dirs, entries;
+  struct inode_key key;
+  struct data_file *df;
+  unsigned long long value[FIELD_COUNT];
+  unsigned char *mark;
+  unsigned int i, r, w, len, records, dropped, stamped;
+  char *tmp, *record;
+  int scan, x, result;
+
+  if((sn->s_gc == 0) && (sn->s_gc_age <= 0)){
+    return 0;
+  }
+
+  if((sn->s_buffer == NULL) || (sn->s_size == 0)){
+    return 0;
+  }
+
+  len = sn->s_fmt_output + 1;
+  records = sn->s_size / len;
+
+  mark = calloc(records, 1);
+  if(mark == NULL){
+    fprintf(stderr, "since: unable to allocate %u bytes for garbage collection\n", records);
+    return -1;
+  }
+
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    if(df->d_offset >= 0){
+      mark[df->d_offset / len] = (sn->s_gc && df->d_deleted) ? GC_DROP : GC_KEEP;
+    }
+  }
+
+  dirs.i_keys = entries.i_keys = NULL;
+  dirs.i_count = entries.i_count = 0;
+  dirs.i_size = entries.i_size = 0;
+
+  /* not finding an inode proves nothing, it may live in a directory we */
+  /* were not told about, so the scan only vouches for files still there */
+  scan = sn->s_gc && (sn->s_gc_age > 0);
+  for(i = 0; scan && (i < sn->s_data_count); i++){
+    if(scan_directory(sn, sn->s_data_files[i].d_name, &dirs, &entries)){
+      fprintf(stderr, "since: unable to tell which tracked files still exist\n");
+      scan = 0;
+    }
+  }
+  if(scan){
+    qsort(entries.i_keys, entries.i_count, sizeof(struct inode_key), &compare_inode_key);
+  }
+
+  result = 0;
+  dropped = 0;
+  stamped = 0;
+
+  for(r = 0; r < records; r++){
+    if(mark[r]){
+      continue;
+    }
+    record = sn->s_buffer + (r * len);
+    for(x = 0; x < FIELD_COUNT; x++){
+      if(parse_field(sn, record, x, &(value[x])) < 0){
+        result = (-1);
+        break;
+      }
+    }
+    if(result < 0){
+      break;
+    }
+
+    if(scan){
+      key.i_dev = value[FIELD_DEVICE];
+      key.i_ino = value[FIELD_INODE];
+      if(bsearch(&key, entries.i_keys, entries.i_count, sizeof(struct inode_key), &compare_inode_key)){
+        continue; /* still there, however long since it was displayed */
+      }
+    }
+
+    if(sn->s_gc_age > 0){
+      if(value[FIELD_SEEN] == 0){
+        /* written by an older version, start the clock now */
+        mark[r] = GC_STAMP;
+        stamped++;
+      } else if((value[FIELD_SEEN] + sn->s_gc_age) < sn->s_now){
+        mark[r] = GC_DROP;
+      }
+    }
+  }
+
+  free(dirs.i_keys);
+  free(entries.i_keys);
+
+  for(r = 0; (result == 0) && (r < records); r++){
+    if(mark[r] == GC_DROP){
+      dropped++;
+    }
+  }
+
+  if((result < 0) || ((dropped == 0) && (stamped == 0))){
+    free(mark);
+    return result;
+  }
+
+  if(sn->s_ismap){
+    /* take a private copy, we are about to compact it */
+    tmp = malloc(sn->s_size);
+    if(tmp == NULL){
+      fprintf(stderr, "since: unable to allocate %d bytes to compact state file\n", sn->s_size);
+      free(mark);
+      return -1;
+    }
+    memcpy(tmp, sn->s_buffer, sn->s_size);
+    munmap(sn->s_buffer, sn->s_size);
+    sn->s_buffer = tmp;
+    sn->s_ismap = 0;
+  }
+
+  for(r = 0, w = 0; r < records; r++){
+    if(mark[r] == GC_DROP){
+      continue;
+    }
+    record = sn->s_buffer + (r * len);
+    if(mark[r] == GC_STAMP){
+      for(x = 0; x < FIELD_COUNT; x++){
+        parse_field(sn, record, x, &(value[x]));
+      }
+      if(print_record(sn, record, value[FIELD_DEVICE], value[FIELD_INODE], value[FIELD_SIZE], value[FIELD_HEAD], value[FIELD_TAIL], value[FIELD_LINE])){
+        free(mark);
+        return -1;
+      }
+      record[sn->s_fmt_output] = '\n';
+    }
+    if(w != r){
+      memmove(sn->s_buffer + (w * len), record, len);
+    }
+    w++;
+  }
+
+  free(mark);
+
+  sn->s_size = w * len;
+
+  for(i = 0; i < sn->s_data_count; i++){
+    /* offsets are stale now, but nothing looks at them after an update */
+    sn->s_data_files[i].d_offset = (-1);
+  }
+
+  if(sn->s_verbose > 1){
+    fprintf(stderr, "since: dropped %u of %u records from %s\n", dropped, records, sn->s_name);
+  }
+
+  return 1;
+}
+
+/* routines to write out new values to state file ************/
+
+static int append_state_file(struct since_state *sn)
+{
+  int sofar, result;
+
+  if((sn->s_append == NULL) || (sn->s_add == 0)){
+    return 0;
+  }
+
+  if(lseek(sn->s_fd, sn->s_size, SEEK_SET) != sn->s_size){
+    fprintf(stderr, "since: unable to seek to end of file %s: %s\n", sn->s_name, strerror(errno));
+    return -1;
+  }
+
+  sofar = 0;
+  while(sofar < sn->s_add){
+    result = write(sn->s_fd, sn->s_append + sofar, sn->s_add - sofar);
+    if(result < 0){
+      switch(errno){
+        case EAGAIN :
+        case EINTR  :
+          break;
+        default :
+          fprintf(stderr, "since: unable to write %d bytes to %s: %s\n", sn->s_add - sofar, sn->s_name, strerror(errno));
+          return -1;
+      }
+    } else {
+      sofar += result;
+      if(result == 0){
+        fprintf(stderr, "since: warning: wrote 0 bytes to file to %s\n", sn->s_name);
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int internal_update_state_file(struct since_state *sn)
+{
+  int sofar, result;
+
+#if 0 /* not needed, always run outof tmp where a new file is opened */
+  if(lseek(sn->s_fd, 0, SEEK_SET) != 0){
+    fprintf(stderr, "since: unable to seek to start of file %s: %s\n", sn->s_name, strerror(errno));
+    return -1;
+  }
+#endif
+
+  sofar = 0;
+  while(sofar < sn->s_size){
+    result = write(sn->s_fd, sn->s_buffer + sofar, sn->s_size - sofar);
+    if(result < 0){
+      switch(errno){
+        case EAGAIN :
+        case EINTR  :
+          break;
+        default :
+          fprintf(stderr, "since: unable to rewrite %d bytes to %s: %s\n", sn->s_size - sofar, sn->s_name, strerror(errno));
+          return -1;
+      }
+    } else {
+      sofar += result;
+      if(result == 0){
+        fprintf(stderr, "since: warning: wrote 0 bytes to file to %s\n", sn->s_name);
+      }
+    }
+  }
+
+  return append_state_file(sn);
+}
+
+static int update_state_file(struct since_state *sn)
+{
+  /* WARNING: this invalidates the structure, forces a forget */
+  char *tmp, *target;
+  int i, j, result, redo, changed;
+  struct data_file *df;
+
+  if(sn->s_readonly){
+    if(sn->s_verbose > 2){
+      fprintf(stderr, "since: readonly, not updatating %s\n", sn->s_name);
+    }
+    return 1;
+  }
+
+  changed = 0;
+  redo = sn->s_atomic;
+  sn->s_now = time(NULL);
+
+  for(i = 0; i < sn->s_data_count; i++){
+    df = &(sn->s_data_files[i]);
+    if((df->d_offset >= 0) && ((sn->s_now - df->d_seen) > SEEN_SLACK)){
+      /* refresh last seen stamp, even if nothing else changed */
+      df->d_write = 1;
+    }
+    if(df->d_write){
+      if(sn->s_gc && df->d_deleted && (df->d_offset < 0)){
+        continue; /* pointless to record a deleted file */
+      }
+      changed = 1;
+      if(df->d_offset < 0){
+        /* awkwardly block duplicate entries */
+        for(j = sn->s_data_count - 1; j > i; j--){
+          if((sn->s_data_files[j].d_ino == df->d_ino) &&
+             (sn->s_data_files[j].d_dev == df->d_dev) &&
+             (sn->s_data_files[j].d_offset < 0) &&
+             sn->s_data_files[j].d_write){
+            break;
+          }
+        }
+        if(i != j){
+          continue; /* will append later, don't do it for this entry */
+        }
+        tmp = realloc(sn->s_append, sn->s_add + sn->s_fmt_output + 1);
+        if(tmp == NULL){
+          fprintf(stderr, "since: unable to allocate %d bytes for append buffer \n", sn->s_add + sn->s_fmt_output + 1);
+          return -1;
+        }
+        sn->s_append = tmp;
+        target = sn->s_append + sn->s_add;
+        sn->s_add += sn->s_fmt_output + 1;
+      } else {
+        target = sn->s_buffer + df->d_offset;
+        redo = sn->s_ismap ? sn->s_atomic : 1; /* rewrite file completely if not mmaped and we modify existing entries */
+      }
+
+      update_fingerprint(sn, df);
+      /* zero lines at a nonzero position means not known */
+      if(print_record(sn, target, df->d_dev, df->d_ino, df->d_pos, df->d_head, df->d_tail, (df->d_lines < 0) ? 0 : df->d_lines)){
+        return -1;
+      }
+      target[sn->s_fmt_output] = '\n'; /* replace \0 with newline */
+    }
+  }
+
+  result = gc_state_file(sn);
+  if(result < 0){
+    return -1;
+  }
+  if(result > 0){
+    /* compaction happens in the same rewrite */
+    changed = 1;
+    redo = 1;
+  }
+
+  if(changed){
+    if(redo){
+      result = tmp_state_file(sn, &internal_update_state_file);
+    } else {
+      result = append_state_file(sn);
+    }
+  } else {
+    result = 0;
+  }
+
+  forget_state_file(sn);
+
+  return result;
+}
+
+/* long options *********************************************/
+
+static int option_gc(struct since_state *sn, char *param)
+{
+  sn->s_gc = 1;
+
+  return 0;
+}
+
+static int option_gc_age(struct since_state *sn, char *param)
+{
+  int days;
+
+  days = atoi(param);
+  if(days <= 0){
+    fprintf(stderr, "since: --gc-age needs a positive number of days\n");
+    return -1;
+  }
+
+  sn->s_gc_age = days * (time_t)86400;
+
+  return 0;
+}
+
+static int option_json(struct since_state *sn, char *param)
+{
+  sn->s_json = 1;
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_tag(struct since_state *sn, char *param)
+{
+  sn->s_prefixes |= PREFIX_TAG;
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_timestamp(struct since_state *sn, char *param)
+{
+  sn->s_prefixes |= PREFIX_TIME;
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_delay(struct since_state *sn, char *param)
+{
+  sn->s_prefixes |= PREFIX_DELAY;
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_count(struct since_state *sn, char *param)
+{
+  sn->s_count |= COUNT_TOTAL;
+
+  return 0;
+}
+
+static int option_match(struct since_state *sn, char *param)
+{
+  char error[MAX_FMT];
+  int result;
+
+  if(sn->s_have_match){
+    fprintf(stderr, "since: only one --match pattern is supported\n");
+    return -1;
+  }
+
+  result = regcomp(&(sn->s_match), param, REG_EXTENDED | REG_NOSUB);
+  if(result){
+    regerror(result, &(sn->s_match), error, MAX_FMT);
+    fprintf(stderr, "since: unable to compile pattern %s: %s\n", param, error);
+    return -1;
+  }
+
+  sn->s_have_match = 1;
+  sn->s_lines = 1;
+  if(sn->s_count == 0){
+    sn->s_count = COUNT_TOTAL;
+  }
+
+  return 0;
+}
+
+static int option_stats(struct since_state *sn, char *param)
+{
+  sn->s_stamp = param;
+  sn->s_count |= COUNT_MINUTE;
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_dedup(struct since_state *sn, char *param)
+{
+  sn->s_dedup = 1;
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_dedup_skip(struct since_state *sn, char *param)
+{
+  sn->s_dedup_skip = atoi(param);
+  if(sn->s_dedup_skip < 0){
+    fprintf(stderr, "since: --dedup-skip needs a number of columns\n");
+    return -1;
+  }
+
+  return option_dedup(sn, param);
+}
+
+static int option_dedup_mask(struct since_state *sn, char *param)
+{
+  char error[MAX_FMT];
+  int result;
+
+  if(sn->s_have_mask){
+    fprintf(stderr, "since: only one --dedup-mask pattern is supported\n");
+    return -1;
+  }
+
+  result = regcomp(&(sn->s_dedup_mask), param, REG_EXTENDED);
+  if(result){
+    regerror(result, &(sn->s_dedup_mask), error, MAX_FMT);
+    fprintf(stderr, "since: unable to compile pattern %s: %s\n", param, error);
+    return -1;
+  }
+
+  sn->s_have_mask = 1;
+
+  return option_dedup(sn, param);
+}
+
+static int option_dedup_window(struct since_state *sn, char *param)
+{
+  int value;
+
+  value = atoi(param);
+  if(value <= 0){
+    fprintf(stderr, "since: --dedup-window needs a positive number of lines\n");
+    return -1;
+  }
+
+  sn->s_dedup_window = value;
+
+  return option_dedup(sn, param);
+}
+
+static int option_sample(struct since_state *sn, char *param)
+{
+  char *ptr;
+  int value;
+
+  /* accept 1/N as well as plain N */
+  ptr = strchr(param, '/');
+  if(ptr){
+    if(atoi(param) != 1){
+      fprintf(stderr, "since: --sample expects a fraction of the form 1/N\n");
+      return -1;
+    }
+    ptr++;
+  } else {
+    ptr = param;
+  }
+
+  value = atoi(ptr);
+  if(value <= 0){
+    fprintf(stderr, "since: --sample needs a positive number\n");
+    return -1;
+  }
+
+  sn->s_sample = value;
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_rate(struct since_state *sn, char *param)
+{
+  char *end;
+
+  sn->s_rate = strtod(param, &end);
+  if((sn->s_rate <= 0.0) || ((*end != '\0') && strcmp(end, "/s"))){
+    fprintf(stderr, "since: --rate expects a number of lines per second, as in 100/s\n");
+    return -1;
+  }
+
+  sn->s_tokens = (sn->s_rate > 1.0) ? sn->s_rate : 1.0;
+  clock_gettime(CLOCK_MONOTONIC, &(sn->s_refill));
+  sn->s_lines = 1;
+
+  return 0;
+}
+
+static int option_uring(struct since_state *sn, char *param)
+{
+#ifdef USE_URING
+  sn->s_uring = 1;
+#else
+  fprintf(stderr, "since: built without io_uring support, using read instead\n");
+#endif
+
+  return 0;
+}
+
+static int option_exec(struct since_state *sn, char *param)
+{
+  sn->s_exec = param;
+  sn->s_output = (-1); /* started once there is something to send */
+
+  /* commits happen while running, so make each one durable */
+  sn->s_atomic = 1;
+  sn->s_sync = 1;
+
+  return 0;
+}
+
+static int option_coprocess(struct since_state *sn, char *param)
+{
+  sn->s_coprocess = 1;
 
   return 0;
 }
 
-static int display_files(struct since_state *sn)
+/* number with an optional k, M or G suffix, zero if invalid */
+static unsigned long parse_size(char *param)
 {
-  unsigned int i;
-  int result, single;
+  char *end;
+  unsigned long value;
+
+  value = strtoul(param, &end, 10);
+  switch(*end){
+    case 'g' : case 'G' :
+      value *= 1024;
+    case 'm' : case 'M' :
+      value *= 1024;
+    case 'k' : case 'K' :
+      value *= 1024;
+      end++;
+      break;
+  }
 
-#ifdef DEBUG
-  fprintf(stderr, "display: have %u files to display\n", sn->s_data_count);
-#endif
+  if(*end != '\0'){
+    return 0;
+  }
 
-  single = (sn->s_data_count == 1)  ? 1 : 0;
+  return value;
+}
 
-  for(i = 0; i < sn->s_data_count; i++){
-    result = display_file(sn, &(sn->s_data_files[i]), single);
-    if(result){
-      return result;
-    }
+static int option_batch(struct since_state *sn, char *param)
+{
+  sn->s_exec_size = parse_size(param);
+  if(sn->s_exec_size == 0){
+    fprintf(stderr, "since: --batch needs a size such as 64k or 4M\n");
+    return -1;
   }
 
   return 0;
 }
 
-/* discard data **********************************************/
-
-static void discard_files(struct since_state *sn)
+static int option_engine(struct since_state *sn, char *param)
 {
-  unsigned int i;
-  struct data_file *df;
-  int single;
+  int i;
 
-#ifdef DEBUG
-  fprintf(stderr, "display: have %u files to display\n", sn->s_data_count);
-#endif
+  for(i = 0; engine_names[i]; i++){
+    if(!strcmp(engine_names[i], param)){
+      break;
+    }
+  }
 
-  single = (sn->s_data_count == 1)  ? 1 : 0;
+  if(engine_names[i] == NULL){
+    fprintf(stderr, "since: unknown engine %s, choose one of", param);
+    for(i = 0; engine_names[i]; i++){
+      fprintf(stderr, " %s", engine_names[i]);
+    }
+    fprintf(stderr, "\n");
+    return -1;
+  }
 
-  for(i = 0; i < sn->s_data_count; i++){
-    df = &(sn->s_data_files[i]);
+  if(i == ENGINE_URING){
+    return option_uring(sn, param);
+  }
 
-    display_header(sn, df, single, 1);
+  sn->s_engine = i;
+  if(i == ENGINE_MMAP){
+    sn->s_domap = 1;
+  }
 
-    if(df->d_pos != df->d_now){
-      df->d_pos = df->d_now;
-      df->d_jump = 1;
-      df->d_write = 1;
-    }
+  return 0;
+}
+
+static int option_read_size(struct since_state *sn, char *param)
+{
+  unsigned long value;
+
+  value = parse_size(param);
+  if((value < IO_BUFFER) || (value > (1UL << 30))){
+    fprintf(stderr, "since: --read-size needs a size between 4k and 1G\n");
+    return -1;
   }
 
+  sn->s_read_max = value;
+
+  return 0;
 }
 
-/* routines to write out new values to state file ************/
+static int option_no_hints(struct since_state *sn, char *param)
+{
+  sn->s_hints = 0;
 
-static int append_state_file(struct since_state *sn)
+  return 0;
+}
+
+static int option_fields(struct since_state *sn, char *param)
 {
-  int sofar, result;
+  unsigned long from, to;
+  char *ptr, *end;
 
-  if((sn->s_append == NULL) || (sn->s_add == 0)){
-    return 0;
+  if(sn->s_pick){
+    fprintf(stderr, "since: only one --fields list is supported\n");
+    return -1;
   }
 
-  if(lseek(sn->s_fd, sn->s_size, SEEK_SET) != sn->s_size){
-    fprintf(stderr, "since: unable to seek to end of file %s: %s\n", sn->s_name, strerror(errno));
+  sn->s_pick = malloc(sizeof(unsigned int) * PICK_MAX);
+  if(sn->s_pick == NULL){
+    fprintf(stderr, "since: unable to allocate field list\n");
     return -1;
   }
 
-  sofar = 0;
-  while(sofar < sn->s_add){
-    result = write(sn->s_fd, sn->s_append + sofar, sn->s_add - sofar);
-    if(result < 0){
-      switch(errno){
-        case EAGAIN :
-        case EINTR  :
-          break;
-        default :
-          fprintf(stderr, "since: unable to write %d bytes to %s: %s\n", sn->s_add - sofar, sn->s_name, strerror(errno));
-          return -1;
+  /* eg 7,1 or 2-4,9 */
+  for(ptr = param; *ptr; ptr = (*end == ',') ? (end + 1) : end){
+    from = strtoul(ptr, &end, 10);
+    to = from;
+    if((*end == '-') && (end > ptr)){
+      to = strtoul(end + 1, &end, 10);
+    }
+    if((end == ptr) || ((*end != ',') && (*end != '\0')) || (from < 1) || (to < from) || (to > PICK_MAX)){
+      fprintf(stderr, "since: --fields needs a list of columns from 1 to %u, eg 1,7 or 2-4\n", PICK_MAX);
+      return -1;
+    }
+    for(; from <= to; from++){
+      if(sn->s_pick_count >= PICK_MAX){
+        fprintf(stderr, "since: --fields picks more than %u columns\n", PICK_MAX);
+        return -1;
       }
-    } else {
-      sofar += result;
-      if(result == 0){
-        fprintf(stderr, "since: warning: wrote 0 bytes to file to %s\n", sn->s_name);
+      sn->s_pick[sn->s_pick_count++] = from;
+      if(from > sn->s_pick_max){
+        sn->s_pick_max = from;
       }
     }
   }
 
+  if(sn->s_pick_count == 0){
+    fprintf(stderr, "since: --fields needs at least one column\n");
+    return -1;
+  }
+
+  sn->s_pick_at = malloc(sizeof(unsigned int) * 2 * sn->s_pick_max);
+  if(sn->s_pick_at == NULL){
+    fprintf(stderr, "since: unable to allocate field list\n");
+    return -1;
+  }
+
+  sn->s_lines = 1;
+
   return 0;
 }
 
-static int internal_update_state_file(struct since_state *sn)
+static int option_delimiter(struct since_state *sn, char *param)
 {
-  int sofar, result;
-
-#if 0 /* not needed, always run outof tmp where a new file is opened */
-  if(lseek(sn->s_fd, 0, SEEK_SET) != 0){
-    fprintf(stderr, "since: unable to seek to start of file %s: %s\n", sn->s_name, strerror(errno));
+  if(!strcmp(param, "\\t")){
+    sn->s_delim = '\t';
+  } else if((strlen(param) == 1) && (param[0] != '\n')){
+    sn->s_delim = param[0];
+  } else {
+    fprintf(stderr, "since: --delimiter needs a single character\n");
     return -1;
   }
-#endif
 
-  sofar = 0;
-  while(sofar < sn->s_size){
-    result = write(sn->s_fd, sn->s_buffer + sofar, sn->s_size - sofar);
-    if(result < 0){
-      switch(errno){
-        case EAGAIN :
-        case EINTR  :
-          break;
-        default :
-          fprintf(stderr, "since: unable to rewrite %d bytes to %s: %s\n", sn->s_size - sofar, sn->s_name, strerror(errno));
-          return -1;
-      }
-    } else {
-      sofar += result;
-      if(result == 0){
-        fprintf(stderr, "since: warning: wrote 0 bytes to file to %s\n", sn->s_name);
-      }
-    }
+  return 0;
+}
+
+static int option_record(struct since_state *sn, char *param)
+{
+  if(param[0] == '\0'){
+    fprintf(stderr, "since: --record needs a non-empty prefix\n");
+    return -1;
   }
 
-  return append_state_file(sn);
+  sn->s_record = param;
+  sn->s_record_len = strlen(param);
+  sn->s_lines = 1;
+
+  return 0;
 }
 
-static int update_state_file(struct since_state *sn)
+static int option_reverse(struct since_state *sn, char *param)
 {
-  /* WARNING: this invalidates the structure, forces a forget */
-  char *tmp, *target;
-  int i, j, result, redo, changed;
-  struct data_file *df;
+  sn->s_reverse = 1;
+  sn->s_lines = 1;
 
-  if(sn->s_readonly){
-    if(sn->s_verbose > 2){
-      fprintf(stderr, "since: readonly, not updatating %s\n", sn->s_name);
-    }
-    return 1;
-  }
+  return 0;
+}
 
-  changed = 0;
-  redo = sn->s_atomic;
+static int option_profile(struct since_state *sn, char *param)
+{
+  sn->s_profile = 1;
 
-  for(i = 0; i < sn->s_data_count; i++){
-    df = &(sn->s_data_files[i]);
-    if(df->d_write){
-      changed = 1;
-      if(df->d_offset < 0){
-        /* awkwardly block duplicate entries */
-        for(j = sn->s_data_count - 1; j > i; j--){
-          if((sn->s_data_files[j].d_ino == df->d_ino) &&
-             (sn->s_data_files[j].d_dev == df->d_dev) &&
-             (sn->s_data_files[j].d_offset < 0) &&
-             sn->s_data_files[j].d_write){
-            break;
-          }
-        }
-        if(i != j){
-          continue; /* will append later, don't do it for this entry */
-        }
-        tmp = realloc(sn->s_append, sn->s_add + sn->s_fmt_output + 1);
-        if(tmp == NULL){
-          fprintf(stderr, "since: unable to allocate %d bytes for append buffer \n", sn->s_add + sn->s_fmt_output + 1);
-          return -1;
-        }
-        sn->s_append = tmp;
-        target = sn->s_append + sn->s_add;
-        sn->s_add += sn->s_fmt_output + 1;
-      } else {
-        target = sn->s_buffer + df->d_offset;
-        redo = sn->s_ismap ? sn->s_atomic : 1; /* rewrite file completely if not mmaped and we modify existing entries */
-      }
+  return 0;
+}
 
-      result = snprintf(target, sn->s_fmt_output + 1, sn->s_fmt, df->d_dev, df->d_ino, df->d_pos);
-      target[sn->s_fmt_output] = '\n'; /* replace \0 with newline */
-      if(result != sn->s_fmt_output){
-        fprintf(stderr, "since: logic failure: wanted to print %d, got %d\n", sn->s_fmt_output, result);
-        return -1;
-      }
+static int option_profile_json(struct since_state *sn, char *param)
+{
+  sn->s_profile = 1;
+  sn->s_prof_file = param;
+
+  return 0;
+}
+
+struct long_map long_table[] = {
+  { "batch",        1, &option_batch },
+  { "coprocess",    0, &option_coprocess },
+  { "count",        0, &option_count },
+  { "dedup",        0, &option_dedup },
+  { "dedup-mask",   1, &option_dedup_mask },
+  { "dedup-skip",   1, &option_dedup_skip },
+  { "dedup-window", 1, &option_dedup_window },
+  { "delay",        0, &option_delay },
+  { "delimiter",    1, &option_delimiter },
+  { "engine",       1, &option_engine },
+  { "exec",         1, &option_exec },
+  { "fields",       1, &option_fields },
+  { "gc",           0, &option_gc },
+  { "gc-age",       1, &option_gc_age },
+  { "json",         0, &option_json },
+  { "match",        1, &option_match },
+  { "no-hints",     0, &option_no_hints },
+  { "profile",      0, &option_profile },
+  { "profile-json", 1, &option_profile_json },
+  { "rate",         1, &option_rate },
+  { "read-size",    1, &option_read_size },
+  { "record",       1, &option_record },
+  { "reverse",      0, &option_reverse },
+  { "sample",       1, &option_sample },
+  { "stats",        1, &option_stats },
+  { "tag",          0, &option_tag },
+  { "timestamp",    0, &option_timestamp },
+  { "uring",        0, &option_uring },
+  { NULL, 0, NULL }
+};
+
+static int long_option(struct since_state *sn, int argc, char **argv, int i)
+{
+  char *name, *param, *eq;
+  int k, len, used;
+
+  name = argv[i] + 2;
+  eq = strchr(name, '=');
+  len = eq ? (eq - name) : strlen(name);
+
+  for(k = 0; long_table[k].l_name; k++){
+    if((strlen(long_table[k].l_name) == len) && !strncmp(long_table[k].l_name, name, len)){
+      break;
     }
   }
 
-  if(changed){
-    if(redo){
-      result = tmp_state_file(sn, &internal_update_state_file);
+  if(long_table[k].l_name == NULL){
+    fprintf(stderr, "since: unknown option --%.*s (use -h for help)\n", len, name);
+    return -1;
+  }
+
+  used = 1;
+  param = NULL;
+
+  if(long_table[k].l_param){
+    if(eq){
+      param = eq + 1;
+    } else if((i + 1) < argc){
+      param = argv[i + 1];
+      used = 2;
     } else {
-      result = append_state_file(sn);
+      fprintf(stderr, "since: --%s needs a parameter\n", long_table[k].l_name);
+      return -1;
     }
-  } else {
-    result = 0;
+  } else if(eq){
+    fprintf(stderr, "since: --%s does not take a parameter\n", long_table[k].l_name);
+    return -1;
   }
 
-  forget_state_file(sn);
+  if((*(long_table[k].l_call))(sn, param)){
+    return -1;
+  }
 
-  return result;
+  return used;
 }
 
 /* main related stuff ***************************************/
@@ -1553,6 +6186,58 @@ static void usage(char *app)
 #ifdef VERSION
   printf(" -V        print version information\n");
 #endif
+  printf(" --gc      drop state records of named files deleted while followed,\n");
+  printf("           with --gc-age let files still in their directories outlive the age\n");
+  printf(" --gc-age days\n");
+  printf("           drop state records of files not seen for the given days\n");
+  printf(" --json    print one json object per line, with file, inode, offset and line number\n");
+  printf(" --tag     prefix each line with the name of its file\n");
+  printf(" --timestamp\n");
+  printf("           prefix each line with its time of arrival\n");
+  printf(" --delay   prefix each line with the seconds between change notification and output\n");
+  printf(" --count   only print the number of new lines and bytes of each file\n");
+  printf(" --match regex\n");
+  printf("           also count the new lines matching the extended regular expression\n");
+  printf(" --stats format\n");
+  printf("           print new lines per minute, taking the time from the line start with strptime format\n");
+  printf(" --fields list\n");
+  printf("           only print the given columns, eg 7,1 or 2-4, separated by whitespace\n");
+  printf(" --delimiter char\n");
+  printf("           columns of --fields are separated by char instead, \\t for a tab\n");
+  printf(" --reverse print new lines newest first\n");
+  printf(" --record prefix\n");
+  printf("           treat a line starting with prefix and the lines up to the next such line as one\n");
+  printf(" --dedup   collapse runs of identical lines into one and a repeat count\n");
+  printf(" --dedup-skip columns\n");
+  printf("           ignore the given number of leading columns when comparing lines\n");
+  printf(" --dedup-mask regex\n");
+  printf("           ignore the first match of regex when comparing lines\n");
+  printf(" --dedup-window lines\n");
+  printf("           drop any line seen among the given number of most recent distinct lines\n");
+  printf(" --sample 1/n\n");
+  printf("           only output about one in n lines, chosen by a hash of their content\n");
+  printf(" --rate n/s\n");
+  printf("           output at most n lines per second, dropping the excess\n");
+  printf(" --engine name\n");
+  printf("           how to get at new data:");
+  for(i = 0; engine_names[i]; i++){
+    printf(" %s", engine_names[i]);
+  }
+  printf("\n");
+  printf(" --read-size size\n");
+  printf("           largest buffer to read into, default 4M\n");
+  printf(" --no-hints\n");
+  printf("           do not give the kernel readahead hints or avoid access time updates\n");
+  printf(" --uring   read with many requests in flight using io_uring, where available\n");
+  printf(" --profile print time spent in each phase, system calls and bytes moved on exit\n");
+  printf(" --profile-json file\n");
+  printf("           write the --profile figures as json to file\n");
+  printf(" --exec command\n");
+  printf("           pipe new data to command, only record it as seen once command succeeds\n");
+  printf(" --coprocess\n");
+  printf("           keep the --exec command running, it acknowledges batches on its output\n");
+  printf(" --batch size\n");
+  printf("           amount of data handed to the --exec command per commit, default 1M\n");
 
   printf("\nExample\n");
   printf(" $ since -lz /var/log/*\n");
@@ -1565,12 +6250,15 @@ int main(int argc, char *argv[])
   int i, j, result, dashes;
   struct since_state state, *sn;
   struct sigaction sag;
+  struct timespec total, t;
+  struct stat st;
   char *state_file;
 
   sn = &state;
   state_file = NULL;
 
   init_state(sn);
+  clock_gettime(CLOCK_MONOTONIC, &total);
 
   i = j = 1;
   dashes = 0;
@@ -1664,8 +6352,17 @@ int main(int argc, char *argv[])
           return EX_OK;
 #endif
         case '-' :
-          if((j == 1) && argv[i][j + 1] == '\0'){
-            dashes = 1;
+          if(j == 1){
+            if(argv[i][j + 1] == '\0'){
+              dashes = 1;
+            } else {
+              result = long_option(sn, argc, argv, i);
+              if(result < 0){
+                return EX_USAGE;
+              }
+              i += result;
+              break;
+            }
           }
           j++;
           break;
@@ -1678,30 +6375,71 @@ int main(int argc, char *argv[])
           return EX_USAGE;
       }
     } else {
-      result = setup_data(sn, argv[i]);
-      if((result < 0) || ((sn->s_relaxed == 0) && result > 0)){
+      if(queue_data(sn, argv[i]) < 0){
         return EX_OSERR;
       }
       i++;
     }
   }
 
+  if(open_data(sn) < 0){
+    return EX_OSERR;
+  }
+
   if(sn->s_data_count <= 0){
     fprintf(stderr, "since: need at least one filename (use -h for help)\n");
     return EX_USAGE;
   }
 
+  if(sn->s_count && (sn->s_json || sn->s_prefixes || sn->s_exec || sn->s_dedup)){
+    fprintf(stderr, "since: counting can not be combined with other output modes\n");
+    return EX_USAGE;
+  }
+
+  if(sn->s_json && sn->s_prefixes){
+    fprintf(stderr, "since: --json output can not be combined with line prefixes\n");
+    return EX_USAGE;
+  }
+
+  if(sn->s_pick && sn->s_json){
+    fprintf(stderr, "since: --fields can not be combined with --json output\n");
+    return EX_USAGE;
+  }
+
+  if(sn->s_delim && (sn->s_pick == NULL)){
+    fprintf(stderr, "since: --delimiter only applies to --fields\n");
+    return EX_USAGE;
+  }
+
+  if(sn->s_coprocess && (sn->s_exec == NULL)){
+    fprintf(stderr, "since: --coprocess needs a command given with --exec\n");
+    return EX_USAGE;
+  }
+
+  if(sn->s_reverse){
+    if(sn->s_exec || sn->s_record){
+      fprintf(stderr, "since: --reverse can not be combined with --exec or --record\n");
+      return EX_USAGE;
+    }
+    sn->s_uring = 0; /* reads backwards on its own */
+  }
+
   /* try to open a list of files */
+  PROF_BEGIN(sn, t);
   if(open_state_file(sn, state_file) < 0){
     return EX_OSERR;
   }
+  PROF_END(sn, t, PROF_OPEN);
 
   /* attempt to load content of said file */
+  PROF_BEGIN(sn, t);
   if(load_state_file(sn) < 0){
     return EX_OSERR;
   }
+  PROF_END(sn, t, PROF_LOAD);
 
   /* look at content, gather size of on disk fields */
+  PROF_BEGIN(sn, t);
   if(check_state_file(sn) < 0){
     return EX_DATAERR;
   }
@@ -1709,14 +6447,17 @@ int main(int argc, char *argv[])
   if(maybe_upgrade_state_file(sn) < 0){
     return EX_OSERR;
   }
+  PROF_END(sn, t, PROF_CHECK);
 
   if(make_fmt_string(sn) < 0){
     return EX_SOFTWARE;
   }
 
+  PROF_BEGIN(sn, t);
   if(lookup_entries(sn) < 0){
     return EX_OSERR;
   }
+  PROF_END(sn, t, PROF_LOOKUP);
 
 #ifdef DEBUG
   for(i = 0; i < sn->s_data_count; i++){
@@ -1724,6 +6465,46 @@ int main(int argc, char *argv[])
   }
 #endif
 
+  /* output of many files is gathered into few writes, unless handed to a command */
+  sn->s_gather = (sn->s_exec == NULL) ? 1 : 0;
+
+  if(sn->s_lines || sn->s_gather){
+    if(setup_batch(sn) < 0){
+      return EX_OSERR;
+    }
+  }
+
+  if(sn->s_dedup_window){
+    if(setup_dedup(sn) < 0){
+      return EX_OSERR;
+    }
+  }
+
+  if((sn->s_output == STDOUT_FILENO) && (fstat(STDOUT_FILENO, &st) == 0) && S_ISFIFO(st.st_mode)){
+    sn->s_to_pipe = 1;
+  }
+
+  if(sn->s_hints){
+    for(i = 0; i < sn->s_data_count; i++){
+      /* only permitted to the owner of a file */
+      if(fcntl(sn->s_data_files[i].d_fd, F_SETFL, O_RDONLY | O_NOATIME) && (sn->s_verbose > 1)){
+        fprintf(stderr, "since: access time of %s will be updated: %s\n", sn->s_data_files[i].d_name, strerror(errno));
+      }
+    }
+  }
+
+#ifdef USE_URING
+  if(sn->s_uring){
+    result = ring_setup(sn);
+    if(result < 0){
+      return EX_OSERR;
+    }
+    if(result > 0){
+      sn->s_uring = 0; /* fall back to plain reads */
+    }
+  }
+#endif
+
   sigemptyset(&(sn->s_set));
   sigaddset(&(sn->s_set), SIGINT);
   sigaddset(&(sn->s_set), SIGPIPE);
@@ -1758,9 +6539,21 @@ int main(int argc, char *argv[])
     }
   }
 
+  if(finish_exec(sn) < 0){
+    /* leaves the state file as the last acknowledged batch left it */
+    return EX_UNAVAILABLE;
+  }
+
+  PROF_BEGIN(sn, t);
   if(update_state_file(sn) < 0){
     return EX_OSERR;
   }
+  PROF_END(sn, t, PROF_UPDATE);
+
+  if(sn->s_profile){
+    prof_span(sn, &total, PROF_TOTAL);
+    prof_report(sn);
+  }
 
   destroy_state(sn);
 